@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "./SimpleKV.hpp"
+
+using namespace std;
+
+namespace simplekv {
+
+namespace {
+
+// the input is cut into chunks of about this many bytes of whole records
+constexpr size_t kChunkBytes = 1 << 20;
+// how many chunks may wait to be parsed before the reader slows down
+constexpr size_t kMaxQueuedChunks = 8;
+
+struct Record {
+  char op;
+  string nspace;
+  string key;
+  string value;
+};
+
+// Turns \t, \n and \\ back into the characters they stand for
+bool unescape(string_view field, string* out) {
+  out->clear();
+  out->reserve(field.size());
+  for (size_t i = 0; i < field.size(); i++) {
+    if (field[i] != '\\') {
+      out->push_back(field[i]);
+      continue;
+    }
+    if (++i == field.size()) {
+      return false;
+    }
+    switch (field[i]) {
+      case 't':
+        out->push_back('\t');
+        break;
+      case 'n':
+        out->push_back('\n');
+        break;
+      case '\\':
+        out->push_back('\\');
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool parse_line(string_view line, Record* rec) {
+  // escaped tabs never show up as real tabs, so we can just split on them
+  string_view fields[4];
+  for (int i = 0; i < 3; i++) {
+    size_t stop = line.find('\t');
+    if (stop == string_view::npos) {
+      return false;
+    }
+    fields[i] = line.substr(0, stop);
+    line.remove_prefix(stop + 1);
+  }
+  fields[3] = line;
+  if (fields[0].size() != 1 || fields[3].find('\t') != string_view::npos) {
+    return false;
+  }
+  rec->op = fields[0][0];
+  return unescape(fields[1], &rec->nspace) &&
+         unescape(fields[2], &rec->key) && unescape(fields[3], &rec->value);
+}
+
+uint32_t read_u32(const char* ptr) {
+  const auto* bytes = reinterpret_cast<const unsigned char*>(ptr);
+  return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+         (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+// Parses every record in a chunk, calling emit on each one
+//
+// Returns:
+// - false if any record is malformed
+template <typename Emit>
+bool parse_chunk(const string& chunk, bulk_format format, Emit emit) {
+  size_t pos = 0;
+  while (pos < chunk.size()) {
+    Record rec;
+    if (format == bulk_format::lines) {
+      size_t stop = chunk.find('\n', pos);
+      if (stop == string::npos) {
+        stop = chunk.size();
+      }
+      string_view line(chunk.data() + pos, stop - pos);
+      pos = stop + 1;
+      // skip blank lines
+      if (line.empty()) {
+        continue;
+      }
+      if (!parse_line(line, &rec)) {
+        return false;
+      }
+    } else {
+      // the reader only cuts chunks at record boundaries, so the lengths
+      // are all there
+      rec.op = chunk[pos++];
+      for (string* field : {&rec.nspace, &rec.key, &rec.value}) {
+        uint32_t len = read_u32(chunk.data() + pos);
+        field->assign(chunk.data() + pos + 4, len);
+        pos += 4 + len;
+      }
+    }
+    if (rec.op != 'S' && rec.op != 'R') {
+      return false;
+    }
+    emit(move(rec));
+  }
+  return true;
+}
+
+// Reads the next chunk of whole records from the input
+//
+// Returns:
+// - false if the input ends in the middle of a binary record
+bool read_chunk(istream& in, bulk_format format, string* chunk) {
+  chunk->clear();
+  if (format == bulk_format::lines) {
+    chunk->resize(kChunkBytes);
+    in.read(&(*chunk)[0], kChunkBytes);
+    chunk->resize(static_cast<size_t>(in.gcount()));
+    // finish the line we stopped in the middle of
+    if (!chunk->empty() && chunk->back() != '\n') {
+      string rest;
+      if (getline(in, rest)) {
+        *chunk += rest;
+      }
+    }
+    return true;
+  }
+  while (chunk->size() < kChunkBytes) {
+    char op;
+    if (!in.get(op)) {
+      return true;
+    }
+    chunk->push_back(op);
+    for (int i = 0; i < 3; i++) {
+      char len_bytes[4];
+      if (!in.read(len_bytes, 4)) {
+        return false;
+      }
+      chunk->append(len_bytes, 4);
+      // the length comes from the input, so don't trust it with one big
+      // allocation. Growing the chunk a piece at a time as the bytes
+      // actually arrive means a bogus length fails on the missing input
+      // instead of asking for 4 GB up front.
+      size_t len = read_u32(len_bytes);
+      while (len > 0) {
+        size_t piece = min(len, kChunkBytes);
+        size_t start = chunk->size();
+        chunk->resize(start + piece);
+        if (!in.read(&(*chunk)[start], static_cast<streamsize>(piece))) {
+          return false;
+        }
+        len -= piece;
+      }
+    }
+  }
+  return true;
+}
+
+// Picks the worker that builds a key, so every record of a key is applied
+// by the same worker
+size_t worker_for(const Record& rec, size_t workers) {
+  size_t hash = std::hash<string>()(rec.nspace);
+  hash ^= std::hash<string>()(rec.key) + 0x9e3779b97f4a7c15ULL + (hash << 6) +
+          (hash >> 2);
+  return hash % workers;
+}
+
+// The chunks waiting to be parsed, numbered in input order
+class ChunkQueue {
+ public:
+  void push(size_t id, string&& chunk) {
+    unique_lock<mutex> lock(mtx);
+    not_full.wait(lock, [this] { return chunks.size() < kMaxQueuedChunks; });
+    chunks.emplace_back(id, move(chunk));
+    not_empty.notify_one();
+  }
+
+  // Returns false once the queue is closed and drained
+  bool pop(size_t* id, string* chunk) {
+    unique_lock<mutex> lock(mtx);
+    not_empty.wait(lock, [this] { return !chunks.empty() || closed; });
+    if (chunks.empty()) {
+      return false;
+    }
+    *id = chunks.front().first;
+    *chunk = move(chunks.front().second);
+    chunks.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  void close() {
+    lock_guard<mutex> lock(mtx);
+    closed = true;
+    not_empty.notify_all();
+  }
+
+ private:
+  mutex mtx;
+  condition_variable not_empty;
+  condition_variable not_full;
+  deque<pair<size_t, string>> chunks;
+  bool closed = false;
+};
+
+// The records one worker has to build, grouped by the chunk they came
+// from. Chunks are parsed in any order but the batches are handed out in
+// chunk order, so the records of a key are applied in input order.
+class Inbox {
+ public:
+  void deliver(size_t chunk_id, vector<Record>&& batch) {
+    lock_guard<mutex> lock(mtx);
+    batches.emplace(chunk_id, move(batch));
+    ready.notify_one();
+  }
+
+  // Takes the batches that are next in chunk order, without waiting
+  vector<vector<Record>> take() {
+    lock_guard<mutex> lock(mtx);
+    return take_locked();
+  }
+
+  // Takes the batches that are next in chunk order, waiting for at least
+  // one unless every chunk up to total has been taken
+  vector<vector<Record>> take_waiting(size_t total) {
+    unique_lock<mutex> lock(mtx);
+    ready.wait(lock, [&] {
+      return next == total || (!batches.empty() && batches.begin()->first == next);
+    });
+    return take_locked();
+  }
+
+  bool done(size_t total) {
+    lock_guard<mutex> lock(mtx);
+    return next == total;
+  }
+
+ private:
+  vector<vector<Record>> take_locked() {
+    vector<vector<Record>> res;
+    while (!batches.empty() && batches.begin()->first == next) {
+      res.push_back(move(batches.begin()->second));
+      batches.erase(batches.begin());
+      next++;
+    }
+    return res;
+  }
+
+  mutex mtx;
+  condition_variable ready;
+  map<size_t, vector<Record>> batches;
+  size_t next = 0;
+};
+
+// Joins the workers when bulk_load returns, however it returns, so that a
+// throw on the reading side can't destroy threads that are still joinable.
+// The workers only stop once the queue is closed, so finish has to close
+// it before we wait on them.
+class WorkerJoiner {
+ public:
+  WorkerJoiner(vector<thread>* workers, function<void()> finish)
+      : workers(workers), finish(move(finish)) {}
+
+  ~WorkerJoiner() { join(); }
+
+  void join() {
+    finish();
+    for (auto& worker : *workers) {
+      if (worker.joinable()) {
+        worker.join();
+      }
+    }
+  }
+
+  WorkerJoiner(const WorkerJoiner&) = delete;
+  WorkerJoiner& operator=(const WorkerJoiner&) = delete;
+
+ private:
+  vector<thread>* workers;
+  function<void()> finish;
+};
+
+}  // namespace
+
+optional<size_t> SimpleKV::bulk_load(istream& in,
+                                     bulk_format format,
+                                     size_t threads) {
+  if (threads == 0) {
+    threads = max<size_t>(1, thread::hardware_concurrency());
+  }
+
+  // read the first chunk as a sample to estimate how big everything will
+  // get. If the stream can tell us its size, scale the sample up to the
+  // whole input, otherwise all we know is what we sampled.
+  auto start_pos = in.tellg();
+  string first;
+  if (!read_chunk(in, format, &first)) {
+    return nullopt;
+  }
+  double scale = 1.0;
+  auto sample_end = in.tellg();
+  if (start_pos != -1 && sample_end != -1 && sample_end > start_pos) {
+    in.seekg(0, ios::end);
+    auto end_pos = in.tellg();
+    in.seekg(sample_end);
+    if (end_pos != -1 && end_pos > sample_end) {
+      scale = static_cast<double>(end_pos - start_pos) /
+              static_cast<double>(sample_end - start_pos);
+    }
+  }
+  // count the distinct keys in the sample per namespace
+  unordered_map<string, unordered_set<string>> sample_keys;
+  if (!parse_chunk(first, format, [&](Record&& rec) {
+        sample_keys[rec.nspace].insert(move(rec.key));
+      })) {
+    return nullopt;
+  }
+
+  // each worker builds its own shard, sized for its share of the keys
+  using Shard = unordered_map<string, KeyMap>;
+  vector<Shard> shards(threads);
+  for (auto& shard : shards) {
+    for (const auto& pair : sample_keys) {
+      shard[pair.first].reserve(
+          static_cast<size_t>(pair.second.size() * scale / threads) + 1);
+    }
+  }
+
+  // every worker both parses chunks and builds its shard out of the
+  // records other workers route to it
+  ChunkQueue chunks;
+  vector<Inbox> inboxes(threads);
+  atomic<size_t> total_chunks{SIZE_MAX};
+  atomic<size_t> records{0};
+  atomic<bool> malformed{false};
+
+  auto build = [](Shard& shard, vector<vector<Record>>&& batches) {
+    for (auto& batch : batches) {
+      for (auto& rec : batch) {
+        auto& key_map = shard[rec.nspace];
+        if (rec.op == 'S') {
+          key_map[rec.key] = move(rec.value);
+          continue;
+        }
+        // rpush, creating the list if needed and skipping strings just
+        // like rpush does
+        auto key_iter = key_map.find(rec.key);
+        if (key_iter == key_map.end()) {
+          key_map.emplace(move(rec.key), vector<string>{move(rec.value)});
+        } else if (holds_alternative<vector<string>>(*key_iter->second)) {
+          get<vector<string>>(key_iter->second.mut())
+              .push_back(move(rec.value));
+        }
+      }
+    }
+  };
+
+  size_t chunk_count = 0;
+  vector<thread> workers;
+  WorkerJoiner joiner(&workers, [&] {
+    total_chunks = chunk_count;
+    chunks.close();
+  });
+  for (size_t w = 0; w < threads; w++) {
+    workers.emplace_back([&, w] {
+      size_t id;
+      string chunk;
+      while (chunks.pop(&id, &chunk)) {
+        vector<vector<Record>> routed(threads);
+        size_t count = 0;
+        if (!parse_chunk(chunk, format, [&](Record&& rec) {
+              routed[worker_for(rec, threads)].push_back(move(rec));
+              count++;
+            })) {
+          malformed = true;
+        }
+        records += count;
+        // every inbox gets a batch, even an empty one, so that it knows the
+        // chunk is done
+        for (size_t d = 0; d < threads; d++) {
+          inboxes[d].deliver(id, move(routed[d]));
+        }
+        build(shards[w], inboxes[w].take());
+      }
+      // the input is all read, finish whatever is still on its way to us
+      size_t total = total_chunks.load();
+      while (!inboxes[w].done(total)) {
+        build(shards[w], inboxes[w].take_waiting(total));
+      }
+    });
+  }
+
+  string chunk = move(first);
+  while (!chunk.empty()) {
+    // only count the chunk once it's queued, the workers wait for every
+    // chunk that was counted
+    chunks.push(chunk_count, move(chunk));
+    chunk_count++;
+    chunk = string();
+    if (!read_chunk(in, format, &chunk)) {
+      malformed = true;
+      break;
+    }
+  }
+  joiner.join();
+  if (malformed) {
+    return nullopt;
+  }
+
+  // publish every shard in one go
+  lock_guard<recursive_mutex> lock(mtx);
+  generation++;
+  for (auto& shard : shards) {
+    for (auto& pair : shard) {
+      if (pair.second.empty()) {
+        continue;
+      }
+      const string& nspace = pair.first;
+      auto& keys = kv_store[nspace];
+      // an S record turns a key into a string for good, so a loaded list
+      // was built from R records only. Where its key is already stored it
+      // is pushed onto what is there, so take those out before the rest is
+      // encoded and moved in.
+      vector<std::pair<string, vector<string>>> appends;
+      if (keys && !keys->empty()) {
+        for (auto iter = pair.second.begin(); iter != pair.second.end();) {
+          if (holds_alternative<vector<string>>(*iter->second) &&
+              keys->find(iter->first) != keys->end()) {
+            appends.emplace_back(
+                iter->first, move(get<vector<string>>(iter->second.mut())));
+            iter = pair.second.erase(iter);
+          } else {
+            ++iter;
+          }
+        }
+      }
+      // namespaces that compress or intern need their values re-encoded,
+      // the workers only build plain values since the pool isn't theirs
+      if (compression.find(nspace) != compression.end() ||
+          interning.find(nspace) != interning.end()) {
+        for (auto& keypair : pair.second) {
+          keypair.second = encode_loaded(nspace, move(keypair.second.mut()));
+        }
+      }
+      // loaded lists change whatever was counted for compression
+      list_bytes.erase(nspace);
+      if (!keys || keys->empty()) {
+        // the common case, the whole namespace moves in without a copy
+        keys = make_shared<KeyMap>(move(pair.second));
+        continue;
+      }
+      auto& key_map = writable(keys);
+      key_map.reserve(key_map.size() + pair.second.size());
+      // merge moves the nodes over, anything left behind was already in the
+      // store and gets replaced by the string loaded for it
+      key_map.merge(pair.second);
+      for (auto& keypair : pair.second) {
+        auto& slot = key_map[keypair.first];
+        discard_spilled(nspace, slot);
+        slot = move(keypair.second);
+      }
+      for (auto& append : appends) {
+        append_loaded(nspace, append.first, move(append.second));
+      }
+    }
+  }
+  // loaded keys may have replaced indexed values, so start those indexes
+  // over rather than patching them key by key
+  for (auto& pair : value_indexes) {
+    rebuild_index(pair.first);
+  }
+  // the loaded values count against the budgets of tiered namespaces, and
+  // were never used, so the sweep has to count them
+  for (auto& pair : tiers) {
+    pair.second.recount = true;
+    sweep(pair.first, pair.second);
+  }
+  // lists may have shown up for callers parked in blpop/brpop
+  for (auto& pair : waiters) {
+    pair.second.ready.notify_all();
+  }
+  return records.load();
+}
+
+SimpleKV::ValueType SimpleKV::encode_loaded(const string& nspace,
+                                            ValueType&& value) {
+  if (holds_alternative<string>(value)) {
+    return make_string_value(nspace, get<string>(value));
+  }
+  auto& list = get<vector<string>>(value);
+  auto iter = compression.find(nspace);
+  if (iter != compression.end()) {
+    size_t bytes = 0;
+    for (const auto& elem : list) {
+      bytes += elem.size();
+    }
+    if (bytes >= iter->second) {
+      return CompressedList(list);
+    }
+  }
+  if (interning.find(nspace) != interning.end()) {
+    InternedList interned;
+    interned.reserve(list.size());
+    for (const auto& elem : list) {
+      interned.push_back(pool.intern(elem));
+    }
+    return interned;
+  }
+  return move(value);
+}
+
+void SimpleKV::append_loaded(const string& nspace,
+                             const string& key,
+                             vector<string>&& elems) {
+  // a spilled list has to come back into memory to be pushed onto
+  tier_access(nspace, key, true);
+  auto& key_map = *kv_store[nspace];
+  auto key_iter = key_map.find(key);
+  if (key_iter == key_map.end()) {
+    return;
+  }
+  // a clone holding the list keeps its own copy
+  auto& value = key_iter->second.mut();
+  if (holds_alternative<vector<string>>(value)) {
+    auto& list = get<vector<string>>(value);
+    list.insert(list.end(), make_move_iterator(elems.begin()),
+                make_move_iterator(elems.end()));
+  } else if (holds_alternative<CompressedList>(value)) {
+    auto& list = get<CompressedList>(value);
+    for (const auto& elem : elems) {
+      list.push_back(elem);
+    }
+  } else if (holds_alternative<InternedList>(value)) {
+    auto& list = get<InternedList>(value);
+    for (const auto& elem : elems) {
+      list.push_back(pool.intern(elem));
+    }
+  } else {
+    // the key holds a string, rpush would have skipped these too
+    return;
+  }
+  // the list may have grown past the compression threshold
+  maybe_compress_list(nspace, key, 0);
+}
+
+}  // namespace simplekv
@@ -0,0 +1,59 @@
+#include "./ChangeFeed.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace simplekv {
+
+Subscription::Subscription(string nspace, string key_prefix, size_t capacity)
+    : nspace(move(nspace)), key_prefix(move(key_prefix)), events(capacity) {}
+
+optional<ChangeEvent> Subscription::poll() {
+  return events.try_pop();
+}
+
+optional<ChangeEvent> Subscription::next(chrono::milliseconds timeout) {
+  // fast path, there is already something waiting for us
+  auto event = events.try_pop();
+  if (event) {
+    return event;
+  }
+  unique_lock<mutex> lock(park_mtx);
+  // say that we are parked before checking the buffer again, so a publish
+  // that lands in between either sees the flag or is seen by the check
+  parked.store(true);
+  atomic_thread_fence(memory_order_seq_cst);
+  park_cv.wait_for(lock, timeout, [this] { return !events.empty(); });
+  parked.store(false);
+  return events.try_pop();
+}
+
+size_t Subscription::dropped() const {
+  return dropped_count.load(memory_order_relaxed);
+}
+
+bool Subscription::matches(const string& nspace, const string& key) const {
+  return this->nspace == nspace &&
+         key.compare(0, key_prefix.size(), key_prefix) == 0;
+}
+
+void Subscription::publish(ChangeEvent event) {
+  if (!events.try_push(move(event))) {
+    // the subscriber is too far behind, drop rather than block the writer
+    dropped_count.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+  // only pay for the lock if the subscriber is actually asleep
+  atomic_thread_fence(memory_order_seq_cst);
+  if (parked.load()) {
+    lock_guard<mutex> lock(park_mtx);
+    park_cv.notify_one();
+  }
+}
+
+}  // namespace simplekv
@@ -0,0 +1,98 @@
+#ifndef CHANGEFEED_HPP_
+#define CHANGEFEED_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "./RingBuffer.hpp"
+
+namespace simplekv {
+
+// Enum that declares the kinds of changes that can be reported
+// to a subscriber of the change feed
+enum class change_type { set, del, lpush, rpush, lpop, rpop, lset };
+
+// A single change made to the store
+struct ChangeEvent {
+  change_type type;
+  std::string nspace;
+  std::string key;
+  // the value that was set, pushed or popped. Empty for del.
+  std::string value;
+};
+
+// A subscription to the changes made to keys of one namespace that start
+// with a given prefix. Created by SimpleKV::subscribe().
+//
+// Events are queued in a bounded lock-free ring buffer. If the subscriber
+// falls behind and the buffer fills up, new events are dropped and counted
+// instead of blocking the writer.
+//
+// A subscription has a single consumer: only one thread at a time should
+// call poll() or next().
+class Subscription {
+ public:
+  // Constructs a subscription
+  //
+  // Arguments:
+  // - nspace: the namespace to watch
+  // - key_prefix: only keys starting with this prefix are reported
+  // - capacity: how many undelivered events may be queued
+  Subscription(std::string nspace, std::string key_prefix, size_t capacity);
+
+  Subscription(const Subscription& other) = delete;
+  Subscription(Subscription&& other) = delete;
+  Subscription& operator=(const Subscription& other) = delete;
+  Subscription& operator=(Subscription&& other) = delete;
+  ~Subscription() = default;
+
+  // Takes the oldest queued event without waiting
+  //
+  // Returns:
+  // - nullopt if no event is queued
+  // - the oldest queued event otherwise
+  std::optional<ChangeEvent> poll();
+
+  // Takes the oldest queued event, parking the caller until one arrives or
+  // the timeout runs out
+  //
+  // Arguments:
+  // - timeout: the longest time to wait for an event
+  //
+  // Returns:
+  // - nullopt if no event arrived in time
+  // - the oldest queued event otherwise
+  std::optional<ChangeEvent> next(std::chrono::milliseconds timeout);
+
+  // Returns the number of events dropped because the buffer was full
+  size_t dropped() const;
+
+  // Returns true iff the event falls in this subscription's namespace and
+  // key prefix
+  bool matches(const std::string& nspace, const std::string& key) const;
+
+  // Queues an event and wakes the subscriber if it is parked. Called by
+  // the store with its lock held, so there is only ever one producer.
+  void publish(ChangeEvent event);
+
+ private:
+  std::string nspace;
+  std::string key_prefix;
+  RingBuffer<ChangeEvent> events;
+  std::atomic<size_t> dropped_count{0};
+
+  // only used to park the consumer in next(), the buffer itself is
+  // lock-free
+  std::atomic<bool> parked{false};
+  std::mutex park_mtx;
+  std::condition_variable park_cv;
+};
+
+}  // namespace simplekv
+
+#endif  // CHANGEFEED_HPP_
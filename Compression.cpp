@@ -0,0 +1,337 @@
+#include "./Compression.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace simplekv {
+
+namespace {
+
+// LZ4 block format constants
+constexpr size_t kMinMatch = 4;
+// the last 5 bytes of a block are always literals
+constexpr size_t kLastLiterals = 5;
+// and the last match has to start at least 12 bytes before the end
+constexpr size_t kMatchLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+
+uint32_t read32(const unsigned char* ptr) {
+  uint32_t val;
+  memcpy(&val, ptr, sizeof(val));
+  return val;
+}
+
+size_t hash32(uint32_t seq) {
+  return (seq * 2654435761U) >> (32 - kHashBits);
+}
+
+// writes a length that didn't fit in its 4 bit token field as a run of
+// 255s followed by the remainder
+void write_length(string* dst, size_t len) {
+  while (len >= 255) {
+    dst->push_back(static_cast<char>(255));
+    len -= 255;
+  }
+  dst->push_back(static_cast<char>(len));
+}
+
+void write_sequence(string* dst,
+                    const unsigned char* literals,
+                    size_t literal_len,
+                    size_t offset,
+                    size_t match_len) {
+  size_t match_code = match_len - kMinMatch;
+  unsigned char token =
+      static_cast<unsigned char>((literal_len < 15 ? literal_len : 15) << 4);
+  token |= static_cast<unsigned char>(match_code < 15 ? match_code : 15);
+  dst->push_back(static_cast<char>(token));
+  if (literal_len >= 15) {
+    write_length(dst, literal_len - 15);
+  }
+  dst->append(reinterpret_cast<const char*>(literals), literal_len);
+  dst->push_back(static_cast<char>(offset & 0xff));
+  dst->push_back(static_cast<char>(offset >> 8));
+  if (match_code >= 15) {
+    write_length(dst, match_code - 15);
+  }
+}
+
+// reads a length continued past its token field, returns false if the block
+// ends in the middle of it
+bool read_length(const unsigned char** ip, const unsigned char* end,
+                 size_t* len) {
+  unsigned char byte;
+  do {
+    if (*ip >= end) {
+      return false;
+    }
+    byte = *(*ip)++;
+    *len += byte;
+  } while (byte == 255);
+  return true;
+}
+
+void write_varint(string* dst, size_t val) {
+  while (val >= 0x80) {
+    dst->push_back(static_cast<char>((val & 0x7f) | 0x80));
+    val >>= 7;
+  }
+  dst->push_back(static_cast<char>(val));
+}
+
+size_t read_varint(const string& src, size_t* pos) {
+  size_t val = 0;
+  int shift = 0;
+  while (*pos < src.size()) {
+    auto byte = static_cast<unsigned char>(src[(*pos)++]);
+    val |= static_cast<size_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+    shift += 7;
+  }
+  return val;
+}
+
+}  // namespace
+
+string compress_block(string_view src) {
+  const auto* base = reinterpret_cast<const unsigned char*>(src.data());
+  size_t len = src.size();
+  string dst;
+  dst.reserve(len + len / 255 + 16);
+
+  size_t anchor = 0;
+  if (len >= kMatchLimit) {
+    // the table remembers the last position each 4 byte sequence was seen
+    vector<uint32_t> table(size_t{1} << kHashBits, 0);
+    size_t ip = 0;
+    size_t limit = len - kMatchLimit;
+    while (ip <= limit) {
+      uint32_t seq = read32(base + ip);
+      size_t slot = hash32(seq);
+      size_t ref = table[slot];
+      table[slot] = static_cast<uint32_t>(ip);
+      if (ref < ip && ip - ref <= kMaxOffset && read32(base + ref) == seq) {
+        // extend the match as far as it goes, but keep the last literals
+        size_t match_len = kMinMatch;
+        size_t max_len = len - kLastLiterals - ip;
+        while (match_len < max_len &&
+               base[ref + match_len] == base[ip + match_len]) {
+          match_len++;
+        }
+        write_sequence(&dst, base + anchor, ip - anchor, ip - ref, match_len);
+        ip += match_len;
+        anchor = ip;
+      } else {
+        ip++;
+      }
+    }
+  }
+  // everything after the last match goes out as literals
+  size_t literal_len = len - anchor;
+  dst.push_back(
+      static_cast<char>((literal_len < 15 ? literal_len : 15) << 4));
+  if (literal_len >= 15) {
+    write_length(&dst, literal_len - 15);
+  }
+  dst.append(reinterpret_cast<const char*>(base + anchor), literal_len);
+  return dst;
+}
+
+string decompress_block(string_view src, size_t raw_size) {
+  const auto* ip = reinterpret_cast<const unsigned char*>(src.data());
+  const auto* end = ip + src.size();
+  string dst;
+  dst.reserve(raw_size);
+
+  while (ip < end) {
+    unsigned char token = *ip++;
+    // copy the literals
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && !read_length(&ip, end, &literal_len)) {
+      break;
+    }
+    if (literal_len > static_cast<size_t>(end - ip) ||
+        dst.size() + literal_len > raw_size) {
+      break;
+    }
+    dst.append(reinterpret_cast<const char*>(ip), literal_len);
+    ip += literal_len;
+    // the last sequence has no match
+    if (ip >= end) {
+      break;
+    }
+    if (end - ip < 2) {
+      break;
+    }
+    size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t match_len = token & 0x0f;
+    if (match_len == 15 && !read_length(&ip, end, &match_len)) {
+      break;
+    }
+    match_len += kMinMatch;
+    if (offset == 0 || offset > dst.size() ||
+        dst.size() + match_len > raw_size) {
+      break;
+    }
+    // the match may overlap what it is writing, so copy a byte at a time
+    size_t from = dst.size() - offset;
+    for (size_t i = 0; i < match_len; i++) {
+      dst.push_back(dst[from + i]);
+    }
+  }
+  return dst;
+}
+
+// CompressedList
+
+CompressedList::CompressedList(const vector<string>& values) {
+  for (size_t i = 0; i < values.size(); i += kChunkElems) {
+    size_t stop = i + kChunkElems < values.size() ? i + kChunkElems
+                                                  : values.size();
+    chunks.push_back(
+        pack(vector<string>(values.begin() + i, values.begin() + stop)));
+  }
+  total = values.size();
+}
+
+CompressedList::Chunk CompressedList::pack(const vector<string>& values) {
+  // each element is its length followed by its bytes
+  string raw;
+  for (const auto& value : values) {
+    write_varint(&raw, value.size());
+    raw += value;
+  }
+  return Chunk{compress_block(raw), values.size(), raw.size()};
+}
+
+vector<string> CompressedList::unpack(const Chunk& chunk) {
+  string raw = decompress_block(chunk.data, chunk.raw_size);
+  vector<string> values;
+  values.reserve(chunk.count);
+  size_t pos = 0;
+  while (values.size() < chunk.count && pos < raw.size()) {
+    size_t len = read_varint(raw, &pos);
+    values.push_back(raw.substr(pos, len));
+    pos += len;
+  }
+  return values;
+}
+
+void CompressedList::locate(size_t index, size_t* chunk, size_t* offset) const {
+  size_t first = chunks.front().count;
+  if (index < first) {
+    *chunk = 0;
+    *offset = index;
+    return;
+  }
+  // every chunk after the first is full, except maybe the last one
+  index -= first;
+  *chunk = 1 + index / kChunkElems;
+  *offset = index % kChunkElems;
+}
+
+size_t CompressedList::size() const {
+  return total;
+}
+
+string CompressedList::at(size_t index) const {
+  size_t chunk;
+  size_t offset;
+  locate(index, &chunk, &offset);
+  return unpack(chunks[chunk])[offset];
+}
+
+void CompressedList::set(size_t index, const string& value) {
+  size_t chunk;
+  size_t offset;
+  locate(index, &chunk, &offset);
+  auto values = unpack(chunks[chunk]);
+  values[offset] = value;
+  chunks[chunk] = pack(values);
+}
+
+void CompressedList::push_front(const string& value) {
+  // start a new chunk once the front one is full
+  if (chunks.empty() || chunks.front().count >= kChunkElems) {
+    chunks.push_front(pack({value}));
+  } else {
+    auto values = unpack(chunks.front());
+    values.insert(values.begin(), value);
+    chunks.front() = pack(values);
+  }
+  total++;
+}
+
+void CompressedList::push_back(const string& value) {
+  if (chunks.empty() || chunks.back().count >= kChunkElems) {
+    chunks.push_back(pack({value}));
+  } else {
+    auto values = unpack(chunks.back());
+    values.push_back(value);
+    chunks.back() = pack(values);
+  }
+  total++;
+}
+
+string CompressedList::pop_front() {
+  auto values = unpack(chunks.front());
+  string res = values.front();
+  values.erase(values.begin());
+  if (values.empty()) {
+    chunks.pop_front();
+  } else {
+    chunks.front() = pack(values);
+  }
+  total--;
+  return res;
+}
+
+string CompressedList::pop_back() {
+  auto values = unpack(chunks.back());
+  string res = values.back();
+  values.pop_back();
+  if (values.empty()) {
+    chunks.pop_back();
+  } else {
+    chunks.back() = pack(values);
+  }
+  total--;
+  return res;
+}
+
+vector<string> CompressedList::members() const {
+  vector<string> res;
+  res.reserve(total);
+  for (const auto& chunk : chunks) {
+    auto values = unpack(chunk);
+    res.insert(res.end(), make_move_iterator(values.begin()),
+               make_move_iterator(values.end()));
+  }
+  return res;
+}
+
+size_t CompressedList::raw_bytes() const {
+  size_t res = 0;
+  for (const auto& chunk : chunks) {
+    res += chunk.raw_size;
+  }
+  return res;
+}
+
+size_t CompressedList::stored_bytes() const {
+  size_t res = 0;
+  for (const auto& chunk : chunks) {
+    res += chunk.data.size();
+  }
+  return res;
+}
+
+}  // namespace simplekv
@@ -0,0 +1,102 @@
+#ifndef COMPRESSION_HPP_
+#define COMPRESSION_HPP_
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace simplekv {
+
+// Compresses a block of bytes using the LZ4 block format. This is a small
+// self contained implementation of the format (greedy matching over a hash
+// of 4 byte sequences), so SimpleKV has no external dependencies.
+//
+// Arguments:
+// - src: the bytes to compress
+//
+// Returns:
+// - the compressed block
+std::string compress_block(std::string_view src);
+
+// Decompresses a block produced by compress_block
+//
+// Arguments:
+// - src: the compressed block
+// - raw_size: the size of the data before it was compressed
+//
+// Returns:
+// - the original bytes. If the block is malformed the result is cut short
+//   rather than reading or writing out of bounds.
+std::string decompress_block(std::string_view src, size_t raw_size);
+
+// A string value stored compressed
+struct CompressedString {
+  std::string data;
+  size_t raw_size;
+};
+
+// A list value stored as a sequence of compressed chunks, so that an
+// operation on one element only has to decompress the chunk holding it.
+//
+// Every chunk except the first and the last holds exactly kChunkElems
+// elements. That lets us find the chunk holding an index without walking
+// the list, and pushes and pops only ever touch the chunk at that end.
+class CompressedList {
+ public:
+  static constexpr size_t kChunkElems = 64;
+
+  // Constructs a compressed copy of the list
+  explicit CompressedList(const std::vector<std::string>& values);
+
+  // Returns the number of elements in the list
+  size_t size() const;
+
+  // Returns a copy of the element at the index, which must be < size()
+  std::string at(size_t index) const;
+
+  // Replaces the element at the index, which must be < size()
+  void set(size_t index, const std::string& value);
+
+  // Adds an element to the front / back of the list
+  void push_front(const std::string& value);
+  void push_back(const std::string& value);
+
+  // Removes and returns the element at the front / back of the list,
+  // which must not be empty
+  std::string pop_front();
+  std::string pop_back();
+
+  // Returns a copy of every element in order
+  std::vector<std::string> members() const;
+
+  // Returns the size of the elements before / after compression
+  size_t raw_bytes() const;
+  size_t stored_bytes() const;
+
+ private:
+  struct Chunk {
+    std::string data;
+    // how many elements are in the chunk
+    size_t count;
+    // the size of the serialized elements before compression
+    size_t raw_size;
+  };
+
+  // Serializes the elements and compresses them into one chunk
+  static Chunk pack(const std::vector<std::string>& values);
+
+  // Decompresses a chunk back into its elements
+  static std::vector<std::string> unpack(const Chunk& chunk);
+
+  // Finds the chunk holding an index and the position inside that chunk
+  void locate(size_t index, size_t* chunk, size_t* offset) const;
+
+  std::deque<Chunk> chunks;
+  size_t total = 0;
+};
+
+}  // namespace simplekv
+
+#endif  // COMPRESSION_HPP_
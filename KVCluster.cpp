@@ -0,0 +1,510 @@
+#include "./KVCluster.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace simplekv {
+
+namespace {
+
+// 64 bit FNV-1a, continued from the passed in hash so that several strings
+// can be hashed as one
+uint64_t fnv1a(const string& str, uint64_t hash = 14695981039346656037ULL) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// FNV-1a alone clusters similar strings on the ring, so we finish with the
+// splitmix64 mixer to spread them out
+uint64_t mix(uint64_t hash) {
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+// how many keys a rebalance moves while holding the cluster's lock, calls
+// on other keys wait for at most one batch
+constexpr size_t kMoveBatch = 64;
+
+// Gets what is at the first point on the ring at or after hash, wrapping
+// around to the start of the ring. The ring must not be empty.
+template <typename T>
+const T& point_for(const map<uint64_t, T>& ring, uint64_t hash) {
+  auto iter = ring.lower_bound(hash);
+  if (iter == ring.end()) {
+    iter = ring.begin();
+  }
+  return iter->second;
+}
+
+}  // namespace
+
+KVCluster::KVCluster(size_t vnodes_per_node)
+    : vnodes(vnodes_per_node == 0 ? 1 : vnodes_per_node) {}
+
+uint64_t KVCluster::key_hash(const string& nspace, const string& key) {
+  // hash the namespace, a separator that can't be confused with the end of
+  // the namespace, and then the key
+  uint64_t hash = fnv1a(nspace);
+  hash = fnv1a(string(1, '\0'), hash);
+  return mix(fnv1a(key, hash));
+}
+
+uint64_t KVCluster::vnode_hash(const string& name, size_t i) {
+  return mix(fnv1a(name + "#" + to_string(i)));
+}
+
+KVNode* KVCluster::owner(const string& nspace, const string& key) {
+  if (ring.empty()) {
+    return nullptr;
+  }
+  // the owner is the first virtual node at or after the key's hash
+  return members.find(point_for(ring, key_hash(nspace, key)))->second.get();
+}
+
+KVNode* KVCluster::route(const string& nspace, const string& key) {
+  KVNode* node = owner(nspace, key);
+  // the common case is no rebalance at all, keep that to one branch
+  if (previous_ring.empty() && joining == nullptr) {
+    return node;
+  }
+  // a key stays where it was until its batch is moved, and batches move
+  // with the lock held exclusively, so the key is on exactly one of these
+  KVNode* previous = previous_ring.empty()
+                         ? nullptr
+                         : point_for(previous_ring, key_hash(nspace, key));
+  // type() is a hashed lookup on a SimpleKV where key_exists() is a scan
+  for (KVNode* source : {previous, joining}) {
+    if (source != nullptr && source != node &&
+        source->type(nspace, key) != value_type_info::none) {
+      return source;
+    }
+  }
+  return node;
+}
+
+// Membership
+
+bool KVCluster::add_node(const string& name, unique_ptr<KVNode> node) {
+  lock_guard<mutex> membership(membership_mtx);
+  KVNode* added = node.get();
+  // remember which nodes held keys before the new node joined, these are
+  // the only ones that can lose keys to it
+  vector<KVNode*> previous;
+  {
+    unique_lock<shared_mutex> lock(mtx);
+    if (node == nullptr || members.find(name) != members.end()) {
+      return false;
+    }
+    for (const auto& pair : members) {
+      previous.push_back(pair.second.get());
+    }
+    for (const auto& point : ring) {
+      previous_ring.emplace(point.first, members[point.second].get());
+    }
+    members[name] = move(node);
+    for (size_t i = 0; i < vnodes; i++) {
+      // on the rare collision the earlier node keeps the point
+      ring.emplace(vnode_hash(name, i), name);
+    }
+    // the new node may already hold data of its own
+    if (!added->namespaces().empty()) {
+      joining = added;
+    }
+  }
+  for (auto* prev : previous) {
+    rebalance_from(prev);
+  }
+  if (joining != nullptr) {
+    rebalance_from(added);
+  }
+  finish_rebalance();
+  return true;
+}
+
+bool KVCluster::add_node(const string& name, SimpleKV* node) {
+  if (node == nullptr) {
+    return false;
+  }
+  return add_node(name, make_unique<LocalNode>(node));
+}
+
+bool KVCluster::remove_node(const string& name) {
+  lock_guard<mutex> membership(membership_mtx);
+  {
+    unique_lock<shared_mutex> lock(mtx);
+    auto member_iter = members.find(name);
+    if (member_iter == members.end()) {
+      return false;
+    }
+    for (const auto& point : ring) {
+      previous_ring.emplace(point.first, members[point.second].get());
+    }
+    // keep the node alive until its keys have moved off it
+    leaving = move(member_iter->second);
+    members.erase(member_iter);
+    // take all of the node's points off the ring
+    for (auto iter = ring.begin(); iter != ring.end();) {
+      if (iter->second == name) {
+        iter = ring.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+  // everything on the node now belongs to someone else
+  if (!ring.empty()) {
+    rebalance_from(leaving.get());
+  }
+  finish_rebalance();
+  return true;
+}
+
+vector<string> KVCluster::nodes() {
+  shared_lock<shared_mutex> lock(mtx);
+  vector<string> res{};
+  for (const auto& pair : members) {
+    res.push_back(pair.first);
+  }
+  return res;
+}
+
+optional<string> KVCluster::node_for(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  if (ring.empty()) {
+    return nullopt;
+  }
+  return point_for(ring, key_hash(nspace, key));
+}
+
+void KVCluster::rebalance_from(KVNode* node) {
+  // nobody else changes the ring while we run, so the keys to look at can
+  // be listed without the lock. Keys created on the node after this are
+  // ones it owns, anything else is created on its owner.
+  for (const auto& nspace : node->namespaces()) {
+    auto keys = node->keys(nspace);
+    for (size_t first = 0; first < keys.size(); first += kMoveBatch) {
+      unique_lock<shared_mutex> lock(mtx);
+      size_t last = min(keys.size(), first + kMoveBatch);
+      for (size_t i = first; i < last; i++) {
+        KVNode* target = owner(nspace, keys[i]);
+        if (target != nullptr && target != node) {
+          move_key(node, target, nspace, keys[i]);
+        }
+      }
+    }
+  }
+}
+
+void KVCluster::finish_rebalance() {
+  unique_lock<shared_mutex> lock(mtx);
+  previous_ring.clear();
+  joining = nullptr;
+  leaving.reset();
+}
+
+void KVCluster::move_key(KVNode* from,
+                         KVNode* to,
+                         const string& nspace,
+                         const string& key) {
+  // the key may have been deleted since the rebalance listed it, and the
+  // lists of other keys can't change while we hold the lock
+  auto type = from->type(nspace, key);
+  if (type == value_type_info::none) {
+    return;
+  }
+  // whatever the target had under this key is stale, the source is the
+  // owner of record until the move completes
+  to->del(nspace, key);
+  if (type == value_type_info::string) {
+    if (auto value = from->sget(nspace, key)) {
+      to->sset(nspace, key, *value);
+    }
+  } else if (auto list = from->lmembers(nspace, key)) {
+    for (const auto& value : *list) {
+      to->rpush(nspace, key, value);
+    }
+  }
+  from->del(nspace, key);
+}
+
+// General Operations
+
+vector<KVNode*> KVCluster::holders() {
+  vector<KVNode*> res{};
+  for (const auto& pair : members) {
+    res.push_back(pair.second.get());
+  }
+  // a node being removed still holds the keys that haven't moved yet
+  if (leaving != nullptr) {
+    res.push_back(leaving.get());
+  }
+  return res;
+}
+
+vector<string> KVCluster::namespaces() {
+  shared_lock<shared_mutex> lock(mtx);
+  // a namespace can be spread over every node, so collect them uniquely
+  unordered_set<string> seen;
+  vector<string> res{};
+  for (auto* node : holders()) {
+    for (auto& nspace : node->namespaces()) {
+      if (seen.insert(nspace).second) {
+        res.push_back(move(nspace));
+      }
+    }
+  }
+  return res;
+}
+
+vector<string> KVCluster::keys(const string& nspace) {
+  shared_lock<shared_mutex> lock(mtx);
+  // every key lives on exactly one node so no de-duplication is needed
+  vector<string> res{};
+  for (auto* node : holders()) {
+    auto node_keys = node->keys(nspace);
+    res.insert(res.end(), make_move_iterator(node_keys.begin()),
+               make_move_iterator(node_keys.end()));
+  }
+  return res;
+}
+
+bool KVCluster::ns_exists(const string& nspace) {
+  shared_lock<shared_mutex> lock(mtx);
+  for (auto* node : holders()) {
+    if (node->ns_exists(nspace)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool KVCluster::key_exists(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  return node != nullptr && node->key_exists(nspace, key);
+}
+
+value_type_info KVCluster::type(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return value_type_info::none;
+  }
+  return node->type(nspace, key);
+}
+
+bool KVCluster::del(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  return node != nullptr && node->del(nspace, key);
+}
+
+// string operations
+
+optional<string> KVCluster::sget(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return nullopt;
+  }
+  return node->sget(nspace, key);
+}
+
+void KVCluster::sset(const string& nspace,
+                     const string& key,
+                     const string& value) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node != nullptr) {
+    node->sset(nspace, key, value);
+  }
+}
+
+// list operations
+
+ssize_t KVCluster::llen(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return -1;
+  }
+  return node->llen(nspace, key);
+}
+
+optional<vector<string>> KVCluster::lmembers(const string& nspace,
+                                             const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return nullopt;
+  }
+  return node->lmembers(nspace, key);
+}
+
+optional<string> KVCluster::lindex(const string& nspace,
+                                   const string& key,
+                                   size_t index) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return nullopt;
+  }
+  return node->lindex(nspace, key, index);
+}
+
+bool KVCluster::lset(const string& nspace,
+                     const string& key,
+                     size_t index,
+                     const string& value) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  return node != nullptr && node->lset(nspace, key, index, value);
+}
+
+bool KVCluster::lpush(const string& nspace,
+                      const string& key,
+                      const string& value) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  return node != nullptr && node->lpush(nspace, key, value);
+}
+
+optional<string> KVCluster::lpop(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return nullopt;
+  }
+  return node->lpop(nspace, key);
+}
+
+bool KVCluster::rpush(const string& nspace,
+                      const string& key,
+                      const string& value) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  return node != nullptr && node->rpush(nspace, key, value);
+}
+
+optional<string> KVCluster::rpop(const string& nspace, const string& key) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node = route(nspace, key);
+  if (node == nullptr) {
+    return nullopt;
+  }
+  return node->rpop(nspace, key);
+}
+
+optional<vector<string>> KVCluster::lunion(const string& nspace1,
+                                           const string& key1,
+                                           const string& nspace2,
+                                           const string& key2) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node1 = route(nspace1, key1);
+  KVNode* node2 = route(nspace2, key2);
+  if (node1 == nullptr) {
+    return vector<string>{};
+  }
+  // if both lists are on the same node let it do all of the work
+  if (node1 == node2) {
+    return node1->lunion(nspace1, key1, nspace2, key2);
+  }
+  // check the types first so that we don't fetch a list for nothing
+  if (node1->type(nspace1, key1) == value_type_info::string ||
+      node2->type(nspace2, key2) == value_type_info::string) {
+    return nullopt;
+  }
+  auto list1 = node1->lmembers(nspace1, key1).value_or(vector<string>{});
+  auto list2 = node2->lmembers(nspace2, key2).value_or(vector<string>{});
+  unordered_set<string> unionSet(make_move_iterator(list1.begin()),
+                                 make_move_iterator(list1.end()));
+  unionSet.insert(make_move_iterator(list2.begin()),
+                  make_move_iterator(list2.end()));
+  return vector<string>(unionSet.begin(), unionSet.end());
+}
+
+optional<vector<string>> KVCluster::linter(const string& nspace1,
+                                           const string& key1,
+                                           const string& nspace2,
+                                           const string& key2) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node1 = route(nspace1, key1);
+  KVNode* node2 = route(nspace2, key2);
+  if (node1 == nullptr) {
+    return nullopt;
+  }
+  if (node1 == node2) {
+    return node1->linter(nspace1, key1, nspace2, key2);
+  }
+  // the intersection needs both values to be lists
+  if (node1->type(nspace1, key1) != value_type_info::list ||
+      node2->type(nspace2, key2) != value_type_info::list) {
+    return nullopt;
+  }
+  auto list1 = node1->lmembers(nspace1, key1).value_or(vector<string>{});
+  auto list2 = node2->lmembers(nspace2, key2).value_or(vector<string>{});
+  unordered_set<string> interSet(make_move_iterator(list2.begin()),
+                                 make_move_iterator(list2.end()));
+  unordered_set<string> addedSet;
+  vector<string> interList;
+  for (const auto& value : list1) {
+    if (interSet.find(value) != interSet.end() &&
+        addedSet.insert(value).second) {
+      interList.push_back(value);
+    }
+  }
+  return interList;
+}
+
+optional<vector<string>> KVCluster::ldiff(const string& nspace1,
+                                          const string& key1,
+                                          const string& nspace2,
+                                          const string& key2) {
+  shared_lock<shared_mutex> lock(mtx);
+  KVNode* node1 = route(nspace1, key1);
+  KVNode* node2 = route(nspace2, key2);
+  if (node1 == nullptr) {
+    return vector<string>{};
+  }
+  if (node1 == node2) {
+    return node1->ldiff(nspace1, key1, nspace2, key2);
+  }
+  if (node1->type(nspace1, key1) == value_type_info::string ||
+      node2->type(nspace2, key2) == value_type_info::string) {
+    return nullopt;
+  }
+  // if the first list is empty the difference is too, so the second list
+  // never has to leave its node
+  auto list1 = node1->lmembers(nspace1, key1).value_or(vector<string>{});
+  if (list1.empty()) {
+    return vector<string>{};
+  }
+  auto list2 = node2->lmembers(nspace2, key2).value_or(vector<string>{});
+  unordered_set<string> diffSet(make_move_iterator(list2.begin()),
+                                make_move_iterator(list2.end()));
+  unordered_set<string> addedSet;
+  vector<string> diffList;
+  for (const auto& value : list1) {
+    if (diffSet.find(value) == diffSet.end() && addedSet.insert(value).second) {
+      diffList.push_back(value);
+    }
+  }
+  return diffList;
+}
+
+}  // namespace simplekv
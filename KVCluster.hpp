@@ -0,0 +1,215 @@
+#ifndef KVCLUSTER_HPP_
+#define KVCLUSTER_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./KVNode.hpp"
+#include "./SimpleKV.hpp"
+
+namespace simplekv {
+
+// A client-side router that partitions the keyspace of several SimpleKV
+// instances using consistent hashing.
+//
+// Every (namespace, key) pair is hashed onto a ring. Each node owns a number
+// of "virtual nodes" (points on the ring), and a key belongs to the first
+// virtual node at or after its hash. Adding or removing a node only moves the
+// keys that fall in the ring ranges that changed hands.
+//
+// The cluster talks to its nodes through the KVNode interface. Only
+// LocalNode exists so far, which keeps every node's SimpleKV in this
+// process, so the cluster currently only simulates sharding: the keys are
+// partitioned, but they all still share one machine's memory. Spreading
+// the data over machines needs a KVNode that talks to a remote server.
+//
+// The cluster owns its KVNode objects but not the SimpleKV instances behind
+// local nodes, those must outlive it. A cluster with no nodes behaves like
+// an empty store and drops writes.
+//
+// All operations are safe to call from several threads at once, including
+// while a node is being added or removed. A rebalance moves keys a small
+// batch at a time, and until a key's batch has moved, calls on it keep
+// going to the node that still holds it, so a write that races the move
+// lands where the move will pick it up. Calls only wait for the batch
+// being moved, not for the whole rebalance. Keys must only be changed
+// through the cluster, a write made straight to a node can race a move.
+class KVCluster {
+ public:
+  // Constructs an empty cluster
+  //
+  // Arguments:
+  // - vnodes_per_node: how many points on the ring each node gets. More
+  //                    points means a more even spread of keys.
+  explicit KVCluster(size_t vnodes_per_node = 128);
+
+  KVCluster(const KVCluster& other) = delete;
+  KVCluster(KVCluster&& other) = delete;
+  KVCluster& operator=(const KVCluster& other) = delete;
+  KVCluster& operator=(KVCluster&& other) = delete;
+  ~KVCluster() = default;
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Membership
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Adds a node to the ring and rebalances, moving every key that the new
+  // node now owns out of the nodes that used to own it. Returns once every
+  // key has moved; one membership change runs at a time.
+  //
+  // Arguments:
+  // - name: a unique name for the node, used to place it on the ring
+  // - node: the node that stores this node's share of the keys
+  //
+  // Returns:
+  // - false if the name is already in use or node is null
+  // - true otherwise
+  bool add_node(const std::string& name, std::unique_ptr<KVNode> node);
+
+  // Adds a SimpleKV instance in this process as a node, see above
+  bool add_node(const std::string& name, SimpleKV* node);
+
+  // Removes a node from the ring and moves all of its keys to the nodes
+  // that now own them. The keys stay on the removed node if it was the
+  // last node in the cluster. The cluster lets go of the node afterwards.
+  //
+  // Arguments:
+  // - name: the name of the node to remove
+  //
+  // Returns:
+  // - true iff the node was part of the cluster
+  bool remove_node(const std::string& name);
+
+  // Gets the names of all of the nodes in the cluster
+  std::vector<std::string> nodes();
+
+  // Gets the name of the node that owns the specified key
+  //
+  // Returns:
+  // - nullopt if the cluster has no nodes
+  // - the name of the owning node otherwise
+  std::optional<std::string> node_for(const std::string& nspace,
+                                      const std::string& key);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // SimpleKV Operations
+  //
+  // These behave exactly like the SimpleKV operations of the same name.
+  /////////////////////////////////////////////////////////////////////////////
+
+  std::vector<std::string> namespaces();
+  std::vector<std::string> keys(const std::string& nspace);
+  bool ns_exists(const std::string& nspace);
+  bool key_exists(const std::string& nspace, const std::string& key);
+  value_type_info type(const std::string& nspace, const std::string& key);
+  bool del(const std::string& nspace, const std::string& key);
+
+  std::optional<std::string> sget(const std::string& nspace,
+                                  const std::string& key);
+  void sset(const std::string& nspace,
+            const std::string& key,
+            const std::string& value);
+
+  ssize_t llen(const std::string& nspace, const std::string& key);
+  std::optional<std::vector<std::string>> lmembers(const std::string& nspace,
+                                                   const std::string& key);
+  std::optional<std::string> lindex(const std::string& nspace,
+                                    const std::string& key,
+                                    size_t index);
+  bool lset(const std::string& nspace,
+            const std::string& key,
+            size_t index,
+            const std::string& value);
+  bool lpush(const std::string& nspace,
+             const std::string& key,
+             const std::string& value);
+  std::optional<std::string> lpop(const std::string& nspace,
+                                  const std::string& key);
+  bool rpush(const std::string& nspace,
+             const std::string& key,
+             const std::string& value);
+  std::optional<std::string> rpop(const std::string& nspace,
+                                  const std::string& key);
+
+  // The set operations run on the owning node when both lists live on the
+  // same node. Otherwise only the lists that are needed to compute the
+  // result are fetched from their nodes.
+  std::optional<std::vector<std::string>> lunion(const std::string& nspace1,
+                                                 const std::string& key1,
+                                                 const std::string& nspace2,
+                                                 const std::string& key2);
+  std::optional<std::vector<std::string>> linter(const std::string& nspace1,
+                                                 const std::string& key1,
+                                                 const std::string& nspace2,
+                                                 const std::string& key2);
+  std::optional<std::vector<std::string>> ldiff(const std::string& nspace1,
+                                                const std::string& key1,
+                                                const std::string& nspace2,
+                                                const std::string& key2);
+
+ private:
+  // Hashes a (namespace, key) pair onto the ring
+  static uint64_t key_hash(const std::string& nspace, const std::string& key);
+
+  // Hashes the i-th virtual node of the named node onto the ring
+  static uint64_t vnode_hash(const std::string& name, size_t i);
+
+  // Gets the node that owns the specified key on the ring, or nullptr if
+  // the cluster is empty. Called with mtx held.
+  KVNode* owner(const std::string& nspace, const std::string& key);
+
+  // Gets the node that holds the specified key: its owner, or while a
+  // rebalance is running, the node it hasn't been moved off yet. Called
+  // with mtx held.
+  KVNode* route(const std::string& nspace, const std::string& key);
+
+  // Moves every key on the specified node that it no longer owns to its
+  // new owner, a batch at a time. Called with membership_mtx held and mtx
+  // not held.
+  void rebalance_from(KVNode* node);
+
+  // Gets every node that may hold keys: the members, and a node that is
+  // being removed. Called with mtx held.
+  std::vector<KVNode*> holders();
+
+  // Ends a rebalance, so that keys are routed by the ring alone again
+  void finish_rebalance();
+
+  // Copies the value of a key from one node to another and deletes it from
+  // the source. Does nothing if the key is gone from the source.
+  static void move_key(KVNode* from,
+                       KVNode* to,
+                       const std::string& nspace,
+                       const std::string& key);
+
+  size_t vnodes;
+
+  // Guards everything below. Operations on keys take it shared, changes to
+  // the ring and each batch of moved keys take it exclusively.
+  std::shared_mutex mtx;
+  // ring position -> node name
+  std::map<uint64_t, std::string> ring;
+  // node name -> node
+  std::unordered_map<std::string, std::unique_ptr<KVNode>> members;
+
+  // While a rebalance is running: the ring as it was before the change,
+  // a removed node that keys are still moving off, and an added node that
+  // came with keys of its own. Empty / null otherwise.
+  std::map<uint64_t, KVNode*> previous_ring;
+  std::unique_ptr<KVNode> leaving;
+  KVNode* joining = nullptr;
+
+  // Lets one add_node / remove_node run at a time
+  std::mutex membership_mtx;
+};
+
+}  // namespace simplekv
+
+#endif  // KVCLUSTER_HPP_
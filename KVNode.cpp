@@ -0,0 +1,112 @@
+#include "./KVNode.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace simplekv {
+
+// everything is passed straight through to the store, whole values are read
+// through a handle
+
+vector<string> LocalNode::namespaces() {
+  return store->namespaces();
+}
+
+vector<string> LocalNode::keys(const string& nspace) {
+  return store->keys(nspace);
+}
+
+bool LocalNode::ns_exists(const string& nspace) {
+  return store->ns_exists(nspace);
+}
+
+bool LocalNode::key_exists(const string& nspace, const string& key) {
+  return store->key_exists(nspace, key);
+}
+
+value_type_info LocalNode::type(const string& nspace, const string& key) {
+  return store->type(nspace, key);
+}
+
+bool LocalNode::del(const string& nspace, const string& key) {
+  return store->del(nspace, key);
+}
+
+optional<string> LocalNode::sget(const string& nspace, const string& key) {
+  // a handle finds the key by hash, where sget by name scans the namespace.
+  // Rebalancing reads every key it moves, so this keeps a move O(keys).
+  return store->sget(store->handle(nspace, key));
+}
+
+void LocalNode::sset(const string& nspace,
+                     const string& key,
+                     const string& value) {
+  store->sset(nspace, key, value);
+}
+
+ssize_t LocalNode::llen(const string& nspace, const string& key) {
+  return store->llen(nspace, key);
+}
+
+optional<vector<string>> LocalNode::lmembers(const string& nspace,
+                                             const string& key) {
+  return store->lmembers(store->handle(nspace, key));
+}
+
+optional<string> LocalNode::lindex(const string& nspace,
+                                   const string& key,
+                                   size_t index) {
+  return store->lindex(nspace, key, index);
+}
+
+bool LocalNode::lset(const string& nspace,
+                     const string& key,
+                     size_t index,
+                     const string& value) {
+  return store->lset(nspace, key, index, value);
+}
+
+bool LocalNode::lpush(const string& nspace,
+                      const string& key,
+                      const string& value) {
+  return store->lpush(nspace, key, value);
+}
+
+optional<string> LocalNode::lpop(const string& nspace, const string& key) {
+  return store->lpop(nspace, key);
+}
+
+bool LocalNode::rpush(const string& nspace,
+                      const string& key,
+                      const string& value) {
+  return store->rpush(nspace, key, value);
+}
+
+optional<string> LocalNode::rpop(const string& nspace, const string& key) {
+  return store->rpop(nspace, key);
+}
+
+optional<vector<string>> LocalNode::lunion(const string& nspace1,
+                                           const string& key1,
+                                           const string& nspace2,
+                                           const string& key2) {
+  return store->lunion(nspace1, key1, nspace2, key2);
+}
+
+optional<vector<string>> LocalNode::linter(const string& nspace1,
+                                           const string& key1,
+                                           const string& nspace2,
+                                           const string& key2) {
+  return store->linter(nspace1, key1, nspace2, key2);
+}
+
+optional<vector<string>> LocalNode::ldiff(const string& nspace1,
+                                          const string& key1,
+                                          const string& nspace2,
+                                          const string& key2) {
+  return store->ldiff(nspace1, key1, nspace2, key2);
+}
+
+}  // namespace simplekv
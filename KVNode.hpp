@@ -0,0 +1,142 @@
+#ifndef KVNODE_HPP_
+#define KVNODE_HPP_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+
+namespace simplekv {
+
+// One member of a KVCluster: the operations the cluster needs from a store
+// that holds a share of the keys.
+//
+// Every operation behaves exactly like the SimpleKV operation of the same
+// name. LocalNode forwards them to a SimpleKV in this process. A client for
+// a SimpleKV running in another process or on another machine can be added
+// by implementing this interface. The cluster calls its nodes from several
+// threads at once, so they have to be thread safe, like SimpleKV is.
+class KVNode {
+ public:
+  virtual ~KVNode() = default;
+
+  virtual std::vector<std::string> namespaces() = 0;
+  virtual std::vector<std::string> keys(const std::string& nspace) = 0;
+  virtual bool ns_exists(const std::string& nspace) = 0;
+  virtual bool key_exists(const std::string& nspace,
+                          const std::string& key) = 0;
+  virtual value_type_info type(const std::string& nspace,
+                               const std::string& key) = 0;
+  virtual bool del(const std::string& nspace, const std::string& key) = 0;
+
+  virtual std::optional<std::string> sget(const std::string& nspace,
+                                          const std::string& key) = 0;
+  virtual void sset(const std::string& nspace,
+                    const std::string& key,
+                    const std::string& value) = 0;
+
+  virtual ssize_t llen(const std::string& nspace, const std::string& key) = 0;
+  virtual std::optional<std::vector<std::string>> lmembers(
+      const std::string& nspace,
+      const std::string& key) = 0;
+  virtual std::optional<std::string> lindex(const std::string& nspace,
+                                            const std::string& key,
+                                            size_t index) = 0;
+  virtual bool lset(const std::string& nspace,
+                    const std::string& key,
+                    size_t index,
+                    const std::string& value) = 0;
+  virtual bool lpush(const std::string& nspace,
+                     const std::string& key,
+                     const std::string& value) = 0;
+  virtual std::optional<std::string> lpop(const std::string& nspace,
+                                          const std::string& key) = 0;
+  virtual bool rpush(const std::string& nspace,
+                     const std::string& key,
+                     const std::string& value) = 0;
+  virtual std::optional<std::string> rpop(const std::string& nspace,
+                                          const std::string& key) = 0;
+
+  virtual std::optional<std::vector<std::string>> lunion(
+      const std::string& nspace1,
+      const std::string& key1,
+      const std::string& nspace2,
+      const std::string& key2) = 0;
+  virtual std::optional<std::vector<std::string>> linter(
+      const std::string& nspace1,
+      const std::string& key1,
+      const std::string& nspace2,
+      const std::string& key2) = 0;
+  virtual std::optional<std::vector<std::string>> ldiff(
+      const std::string& nspace1,
+      const std::string& key1,
+      const std::string& nspace2,
+      const std::string& key2) = 0;
+};
+
+// A node backed by a SimpleKV in this process. It does not own the store,
+// the store must outlive it.
+class LocalNode : public KVNode {
+ public:
+  explicit LocalNode(SimpleKV* store) : store(store) {}
+
+  std::vector<std::string> namespaces() override;
+  std::vector<std::string> keys(const std::string& nspace) override;
+  bool ns_exists(const std::string& nspace) override;
+  bool key_exists(const std::string& nspace, const std::string& key) override;
+  value_type_info type(const std::string& nspace,
+                       const std::string& key) override;
+  bool del(const std::string& nspace, const std::string& key) override;
+
+  std::optional<std::string> sget(const std::string& nspace,
+                                  const std::string& key) override;
+  void sset(const std::string& nspace,
+            const std::string& key,
+            const std::string& value) override;
+
+  ssize_t llen(const std::string& nspace, const std::string& key) override;
+  std::optional<std::vector<std::string>> lmembers(
+      const std::string& nspace,
+      const std::string& key) override;
+  std::optional<std::string> lindex(const std::string& nspace,
+                                    const std::string& key,
+                                    size_t index) override;
+  bool lset(const std::string& nspace,
+            const std::string& key,
+            size_t index,
+            const std::string& value) override;
+  bool lpush(const std::string& nspace,
+             const std::string& key,
+             const std::string& value) override;
+  std::optional<std::string> lpop(const std::string& nspace,
+                                  const std::string& key) override;
+  bool rpush(const std::string& nspace,
+             const std::string& key,
+             const std::string& value) override;
+  std::optional<std::string> rpop(const std::string& nspace,
+                                  const std::string& key) override;
+
+  std::optional<std::vector<std::string>> lunion(
+      const std::string& nspace1,
+      const std::string& key1,
+      const std::string& nspace2,
+      const std::string& key2) override;
+  std::optional<std::vector<std::string>> linter(
+      const std::string& nspace1,
+      const std::string& key1,
+      const std::string& nspace2,
+      const std::string& key2) override;
+  std::optional<std::vector<std::string>> ldiff(
+      const std::string& nspace1,
+      const std::string& key1,
+      const std::string& nspace2,
+      const std::string& key2) override;
+
+ private:
+  SimpleKV* store;
+};
+
+}  // namespace simplekv
+
+#endif  // KVNODE_HPP_
@@ -0,0 +1,206 @@
+#include <mutex>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+#include "./SimpleKV.hpp"
+
+using namespace std;
+
+namespace simplekv {
+
+// The operations below work on the stored value directly when it is a plain
+// string or list. Anything else, including values encoded before a setting
+// was turned off, takes the regular path.
+
+KeyHandle SimpleKV::handle(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
+  return KeyHandle(id, nspace, key);
+}
+
+bool SimpleKV::key_exists(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  if (resolve(handle) != nullptr) {
+    return true;
+  }
+  return key_exists(handle.nspace(), handle.key());
+}
+
+value_type_info SimpleKV::type(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* value = resolve(handle);
+  if (value != nullptr && holds_alternative<string>(*value)) {
+    return value_type_info::string;
+  }
+  if (value != nullptr && holds_alternative<vector<string>>(*value)) {
+    return value_type_info::list;
+  }
+  return type(handle.nspace(), handle.key());
+}
+
+bool SimpleKV::del(const KeyHandle& handle) {
+  // deleting erases the slot anyway, nothing to save
+  return del(handle.nspace(), handle.key());
+}
+
+optional<string> SimpleKV::sget(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* value = resolve(handle);
+  if (value == nullptr || !holds_alternative<string>(*value)) {
+    return sget(handle.nspace(), handle.key());
+  }
+  return get<string>(*value);
+}
+
+void SimpleKV::sset(const KeyHandle& handle, const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* slot = resolve(handle);
+  if (slot == nullptr) {
+    sset(handle.nspace(), handle.key(), value);
+    return;
+  }
+  // whatever was there before, the namespace stores new strings as is
+  *slot = value;
+  publish(change_type::set, handle.nspace(), handle.key(), value);
+}
+
+ssize_t SimpleKV::llen(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* value = resolve(handle);
+  if (value == nullptr || !holds_alternative<vector<string>>(*value)) {
+    return llen(handle.nspace(), handle.key());
+  }
+  return static_cast<ssize_t>(get<vector<string>>(*value).size());
+}
+
+optional<string> SimpleKV::lindex(const KeyHandle& handle, size_t index) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* value = resolve(handle);
+  if (value == nullptr || !holds_alternative<vector<string>>(*value)) {
+    return lindex(handle.nspace(), handle.key(), index);
+  }
+  const auto& list = get<vector<string>>(*value);
+  if (index < list.size()) {
+    return list[index];
+  }
+  return nullopt;
+}
+
+optional<vector<string>> SimpleKV::lmembers(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* value = resolve(handle);
+  if (value == nullptr || !holds_alternative<vector<string>>(*value)) {
+    return lmembers(handle.nspace(), handle.key());
+  }
+  return get<vector<string>>(*value);
+}
+
+bool SimpleKV::lset(const KeyHandle& handle,
+                    size_t index,
+                    const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* slot = resolve(handle);
+  if (slot == nullptr || !holds_alternative<vector<string>>(*slot)) {
+    return lset(handle.nspace(), handle.key(), index, value);
+  }
+  auto& list = get<vector<string>>(*slot);
+  if (index >= list.size()) {
+    return false;
+  }
+  list[index] = value;
+  publish(change_type::lset, handle.nspace(), handle.key(), value);
+  return true;
+}
+
+bool SimpleKV::lpush(const KeyHandle& handle, const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* slot = resolve(handle);
+  if (slot == nullptr || !holds_alternative<vector<string>>(*slot)) {
+    return lpush(handle.nspace(), handle.key(), value);
+  }
+  auto& list = get<vector<string>>(*slot);
+  list.insert(list.begin(), value);
+  pushed(change_type::lpush, handle.nspace(), handle.key(), value);
+  return true;
+}
+
+bool SimpleKV::rpush(const KeyHandle& handle, const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* slot = resolve(handle);
+  if (slot == nullptr || !holds_alternative<vector<string>>(*slot)) {
+    return rpush(handle.nspace(), handle.key(), value);
+  }
+  get<vector<string>>(*slot).push_back(value);
+  pushed(change_type::rpush, handle.nspace(), handle.key(), value);
+  return true;
+}
+
+optional<string> SimpleKV::lpop(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* slot = resolve(handle);
+  // popping the last element erases the key, leave that to the regular path
+  if (slot == nullptr || !holds_alternative<vector<string>>(*slot) ||
+      get<vector<string>>(*slot).size() < 2) {
+    return lpop(handle.nspace(), handle.key());
+  }
+  auto& list = get<vector<string>>(*slot);
+  string pop = move(list.front());
+  list.erase(list.begin());
+  popped(change_type::lpop, handle.nspace(), handle.key(), pop);
+  return pop;
+}
+
+optional<string> SimpleKV::rpop(const KeyHandle& handle) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto* slot = resolve(handle);
+  if (slot == nullptr || !holds_alternative<vector<string>>(*slot) ||
+      get<vector<string>>(*slot).size() < 2) {
+    return rpop(handle.nspace(), handle.key());
+  }
+  auto& list = get<vector<string>>(*slot);
+  string pop = move(list.back());
+  list.pop_back();
+  popped(change_type::rpop, handle.nspace(), handle.key(), pop);
+  return pop;
+}
+
+// private helpers
+
+SimpleKV::ValueType* SimpleKV::resolve(const KeyHandle& handle) {
+  // a handle from another object, or from a destroyed one that lived at
+  // our address, knows nothing about our keys
+  if (handle.owner != id) {
+    return nullptr;
+  }
+  // keys that didn't exist may have been created since, so a missing key is
+  // always looked up again
+  if (handle.generation == generation && handle.slot != nullptr) {
+    return handle.direct ? &handle.slot->mut() : nullptr;
+  }
+  handle.generation = generation;
+  handle.slot = nullptr;
+  handle.direct = false;
+  auto first_iter = kv_store.find(handle.nspace());
+  if (first_iter == kv_store.end()) {
+    return nullptr;
+  }
+  auto key_iter = first_iter->second->find(handle.key());
+  if (key_iter == first_iter->second->end()) {
+    return nullptr;
+  }
+  handle.slot = &key_iter->second;
+  // anything that encodes, indexes or tiers new values, or keys or a value
+  // shared with a clone, needs the bookkeeping the regular path does. A
+  // value that isn't shared stays where it is until generation changes, a
+  // clone bumps it before sharing anything.
+  const string& nspace = handle.nspace();
+  handle.direct = first_iter->second.use_count() == 1 &&
+                  !key_iter->second.shared() &&
+                  compression.find(nspace) == compression.end() &&
+                  interning.find(nspace) == interning.end() &&
+                  value_indexes.find(nspace) == value_indexes.end() &&
+                  tiers.find(nspace) == tiers.end();
+  return handle.direct ? &handle.slot->mut() : nullptr;
+}
+
+}  // namespace simplekv
@@ -0,0 +1,108 @@
+#include "./Query.hpp"
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+namespace simplekv {
+
+// ValueRef
+
+value_type_info ValueRef::type() const {
+  if (holds_alternative<string>(value) ||
+      holds_alternative<CompressedString>(value) ||
+      holds_alternative<InternedString>(value)) {
+    return value_type_info::string;
+  }
+  return value_type_info::list;
+}
+
+size_t ValueRef::size() const {
+  if (holds_alternative<string>(value)) {
+    return get<string>(value).size();
+  }
+  if (holds_alternative<CompressedString>(value)) {
+    return get<CompressedString>(value).raw_size;
+  }
+  if (holds_alternative<InternedString>(value)) {
+    return get<InternedString>(value).str().size();
+  }
+  if (holds_alternative<vector<string>>(value)) {
+    return get<vector<string>>(value).size();
+  }
+  if (holds_alternative<CompressedList>(value)) {
+    return get<CompressedList>(value).size();
+  }
+  return get<SimpleKV::InternedList>(value).size();
+}
+
+optional<string_view> ValueRef::view() const {
+  if (holds_alternative<string>(value)) {
+    return string_view(get<string>(value));
+  }
+  if (holds_alternative<InternedString>(value)) {
+    return string_view(get<InternedString>(value).str());
+  }
+  return nullopt;
+}
+
+string ValueRef::str() const {
+  if (holds_alternative<CompressedString>(value)) {
+    const auto& packed = get<CompressedString>(value);
+    return decompress_block(packed.data, packed.raw_size);
+  }
+  auto in_place = view();
+  return in_place ? string(*in_place) : string();
+}
+
+// QueryEngine
+
+namespace {
+
+// how many ranges we aim to give each worker, more ranges means more
+// chances to even out the load by stealing
+constexpr size_t kRangesPerWorker = 8;
+
+}  // namespace
+
+QueryEngine::QueryEngine(SimpleKV& kv, size_t threads)
+    : kv(kv), pool(threads) {}
+
+vector<QueryEngine::Range> QueryEngine::plan(
+    const optional<string>& nspace) {
+  vector<Range> ranges;
+  // pick the namespaces to scan
+  vector<const pair<const string, shared_ptr<KeyMap>>*> selected;
+  size_t total_buckets = 0;
+  if (nspace) {
+    auto iter = kv.kv_store.find(*nspace);
+    if (iter != kv.kv_store.end()) {
+      selected.push_back(&*iter);
+      total_buckets += iter->second->bucket_count();
+    }
+  } else {
+    for (const auto& pair : kv.kv_store) {
+      selected.push_back(&pair);
+      total_buckets += pair.second->bucket_count();
+    }
+  }
+  // cut the buckets into ranges of about the same size. A small namespace
+  // still gets a range of its own.
+  size_t grain =
+      max<size_t>(1, total_buckets / (pool.size() * kRangesPerWorker));
+  for (const auto* pair : selected) {
+    size_t buckets = pair->second->bucket_count();
+    for (size_t b = 0; b < buckets; b += grain) {
+      ranges.push_back(
+          Range{&pair->first, pair->second.get(), b, min(b + grain, buckets)});
+    }
+  }
+  return ranges;
+}
+
+}  // namespace simplekv
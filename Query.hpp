@@ -0,0 +1,327 @@
+#ifndef QUERY_HPP_
+#define QUERY_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./ThreadPool.hpp"
+
+namespace simplekv {
+
+// A read-only view of a value stored in a SimpleKV object, handed to the
+// callbacks of a query. Strings and list elements are read where they are
+// stored whenever the representation allows it. A ValueRef is only valid
+// during the callback it was passed to.
+class ValueRef {
+ public:
+  // Returns whether the value is a string or a list
+  value_type_info type() const;
+
+  // Returns the length of the string or the number of elements in the list
+  size_t size() const;
+
+  // Returns the string in place
+  //
+  // Returns:
+  // - nullopt if the value is a list or a compressed string
+  // - a view of the stored string otherwise
+  std::optional<std::string_view> view() const;
+
+  // Returns a copy of the string, expanding it if it is compressed, or the
+  // empty string if the value is a list
+  std::string str() const;
+
+  // Calls fn with a std::string_view of every element of the list, in
+  // order. Does nothing if the value is a string.
+  template <typename Fn>
+  void for_each(Fn fn) const;
+
+ private:
+  friend class QueryEngine;
+
+  explicit ValueRef(const SimpleKV::ValueType& value) : value(value) {}
+
+  const SimpleKV::ValueType& value;
+};
+
+// One of the results of QueryEngine::top_k
+template <typename Score>
+struct Ranked {
+  std::string nspace;
+  std::string key;
+  Score score;
+};
+
+// Runs scan / filter / aggregate queries over the values of a SimpleKV
+// object on a pool of worker threads.
+//
+// A query walks the buckets of the store's hash tables directly, split
+// into ranges that the workers share out with work stealing, and hands
+// each value to the callbacks as a ValueRef without copying it.
+//
+// Values spilled by tiered storage are read back for the callback and
+// left on disk.
+//
+// The store is locked for the whole query, map_reduce, count, for_each
+// and top_k alike, so writers on the store stall until the query is done.
+// Clones share the lock of the store they came from (see
+// SimpleKV::clone), so querying a clone stalls writers on the store and on
+// every other clone of it just the same; a clone is not a way to query
+// without blocking writers.
+//
+// The callbacks run on several threads at once and must not call back
+// into the SimpleKV object.
+//
+// Every query takes the namespace to scan, or nullopt to scan every
+// namespace.
+class QueryEngine {
+ public:
+  // Constructs a query engine over the specified object
+  //
+  // Arguments:
+  // - kv: the object to query, which must outlive the engine
+  // - threads: how many worker threads to run queries on, 0 means one
+  //            per core
+  explicit QueryEngine(SimpleKV& kv, size_t threads = 0);
+
+  QueryEngine(const QueryEngine& other) = delete;
+  QueryEngine(QueryEngine&& other) = delete;
+  QueryEngine& operator=(const QueryEngine& other) = delete;
+  QueryEngine& operator=(QueryEngine&& other) = delete;
+  ~QueryEngine() = default;
+
+  // Maps every value that matches the predicate and reduces the results
+  //
+  // Arguments:
+  // - nspace: the namespace to scan, nullopt for all of them
+  // - pred: bool(const std::string& nspace, const std::string& key,
+  //              const ValueRef& value), whether to include the value
+  // - map: Acc(const std::string& nspace, const std::string& key,
+  //            const ValueRef& value), the value's contribution
+  // - reduce: Acc(Acc a, Acc b), combines two contributions. It must be
+  //           associative and commutative, since the values are visited
+  //           in no particular order.
+  // - init: the result if nothing matches, reduced into once otherwise
+  //
+  // Returns:
+  // - the reduction of init and every matching value's contribution
+  template <typename Acc, typename Pred, typename Map, typename Reduce>
+  Acc map_reduce(const std::optional<std::string>& nspace,
+                 Pred pred,
+                 Map map,
+                 Reduce reduce,
+                 Acc init);
+
+  // Counts the values that match the predicate
+  template <typename Pred>
+  size_t count(const std::optional<std::string>& nspace, Pred pred);
+
+  // Calls fn on every value that matches the predicate, streaming them out
+  // as they are found. fn is called from several threads at once.
+  template <typename Pred, typename Fn>
+  void for_each(const std::optional<std::string>& nspace, Pred pred, Fn fn);
+
+  // Finds the k values with the highest score
+  //
+  // Arguments:
+  // - nspace: the namespace to scan, nullopt for all of them
+  // - k: how many results we want
+  // - score: Score(const std::string& nspace, const std::string& key,
+  //                const ValueRef& value)
+  //
+  // Returns:
+  // - up to k results, highest score first
+  template <typename ScoreFn>
+  auto top_k(const std::optional<std::string>& nspace, size_t k, ScoreFn score)
+      -> std::vector<Ranked<decltype(score(std::string(),
+                                           std::string(),
+                                           std::declval<ValueRef&>()))>>;
+
+ private:
+  using KeyMap = SimpleKV::KeyMap;
+
+  // A range of buckets of one namespace's hash table
+  struct Range {
+    const std::string* nspace;
+    const KeyMap* keys;
+    size_t first_bucket;
+    size_t last_bucket;
+  };
+
+  // Splits the selected namespaces into bucket ranges. Called with the
+  // store locked.
+  std::vector<Range> plan(const std::optional<std::string>& nspace);
+
+  // Calls visit(range_index, nspace, key, value) on every value in every
+  // range, spreading the ranges over the pool. Called with the store
+  // locked.
+  template <typename Visit>
+  void run(const std::vector<Range>& ranges, Visit visit);
+
+  SimpleKV& kv;
+  ThreadPool pool;
+};
+
+template <typename Fn>
+void ValueRef::for_each(Fn fn) const {
+  if (std::holds_alternative<std::vector<std::string>>(value)) {
+    for (const auto& elem : std::get<std::vector<std::string>>(value)) {
+      fn(std::string_view(elem));
+    }
+  } else if (std::holds_alternative<SimpleKV::InternedList>(value)) {
+    for (const auto& elem : std::get<SimpleKV::InternedList>(value)) {
+      fn(std::string_view(elem.str()));
+    }
+  } else if (std::holds_alternative<CompressedList>(value)) {
+    for (const auto& elem : std::get<CompressedList>(value).members()) {
+      fn(std::string_view(elem));
+    }
+  }
+}
+
+template <typename Visit>
+void QueryEngine::run(const std::vector<Range>& ranges, Visit visit) {
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(ranges.size());
+  for (size_t i = 0; i < ranges.size(); i++) {
+    tasks.emplace_back([this, &ranges, &visit, i] {
+      const Range& range = ranges[i];
+      for (size_t b = range.first_bucket; b < range.last_bucket; b++) {
+        for (auto iter = range.keys->begin(b); iter != range.keys->end(b);
+             ++iter) {
+          // spilled values are read back into a temporary, they stay on
+          // disk
+          if (std::holds_alternative<SpilledValue>(*iter->second)) {
+            auto loaded = kv.read_spilled(
+                *range.nspace, std::get<SpilledValue>(*iter->second));
+            if (loaded) {
+              visit(i, *range.nspace, iter->first, ValueRef(*loaded));
+            }
+            continue;
+          }
+          visit(i, *range.nspace, iter->first, ValueRef(*iter->second));
+        }
+      }
+    });
+  }
+  pool.run(std::move(tasks));
+}
+
+template <typename Acc, typename Pred, typename Map, typename Reduce>
+Acc QueryEngine::map_reduce(const std::optional<std::string>& nspace,
+                            Pred pred,
+                            Map map,
+                            Reduce reduce,
+                            Acc init) {
+  std::lock_guard<std::recursive_mutex> lock(kv.mtx);
+  auto ranges = plan(nspace);
+  // each range reduces into its own partial result, so the workers never
+  // share anything
+  std::vector<std::optional<Acc>> partials(ranges.size());
+  run(ranges, [&](size_t i, const std::string& ns, const std::string& key,
+                  const ValueRef& value) {
+    if (!pred(ns, key, value)) {
+      return;
+    }
+    if (partials[i]) {
+      partials[i] = reduce(std::move(*partials[i]), map(ns, key, value));
+    } else {
+      partials[i] = map(ns, key, value);
+    }
+  });
+  Acc res = std::move(init);
+  for (auto& partial : partials) {
+    if (partial) {
+      res = reduce(std::move(res), std::move(*partial));
+    }
+  }
+  return res;
+}
+
+template <typename Pred>
+size_t QueryEngine::count(const std::optional<std::string>& nspace,
+                          Pred pred) {
+  return map_reduce(
+      nspace, pred,
+      [](const std::string&, const std::string&, const ValueRef&) {
+        return size_t{1};
+      },
+      [](size_t a, size_t b) { return a + b; }, size_t{0});
+}
+
+template <typename Pred, typename Fn>
+void QueryEngine::for_each(const std::optional<std::string>& nspace,
+                           Pred pred,
+                           Fn fn) {
+  std::lock_guard<std::recursive_mutex> lock(kv.mtx);
+  auto ranges = plan(nspace);
+  run(ranges, [&](size_t, const std::string& ns, const std::string& key,
+                  const ValueRef& value) {
+    if (pred(ns, key, value)) {
+      fn(ns, key, value);
+    }
+  });
+}
+
+template <typename ScoreFn>
+auto QueryEngine::top_k(const std::optional<std::string>& nspace,
+                        size_t k,
+                        ScoreFn score)
+    -> std::vector<Ranked<decltype(score(std::string(),
+                                         std::string(),
+                                         std::declval<ValueRef&>()))>> {
+  using Score = decltype(score(std::string(), std::string(),
+                               std::declval<ValueRef&>()));
+  // a min-heap on score, so the weakest of the best k is on top
+  auto worse = [](const Ranked<Score>& a, const Ranked<Score>& b) {
+    return a.score > b.score;
+  };
+  std::vector<Ranked<Score>> res;
+  if (k == 0) {
+    return res;
+  }
+  std::lock_guard<std::recursive_mutex> lock(kv.mtx);
+  auto ranges = plan(nspace);
+  std::vector<std::vector<Ranked<Score>>> heaps(ranges.size());
+  run(ranges, [&](size_t i, const std::string& ns, const std::string& key,
+                  const ValueRef& value) {
+    auto& heap = heaps[i];
+    Score s = score(ns, key, value);
+    if (heap.size() == k) {
+      // only copy the names out if the value makes the cut
+      if (!(heap.front().score < s)) {
+        return;
+      }
+      std::pop_heap(heap.begin(), heap.end(), worse);
+      heap.pop_back();
+    }
+    heap.push_back(Ranked<Score>{ns, key, s});
+    std::push_heap(heap.begin(), heap.end(), worse);
+  });
+  for (auto& heap : heaps) {
+    for (auto& ranked : heap) {
+      res.push_back(std::move(ranked));
+    }
+  }
+  std::sort(res.begin(), res.end(),
+            [](const Ranked<Score>& a, const Ranked<Score>& b) {
+              return a.score > b.score;
+            });
+  if (res.size() > k) {
+    res.erase(res.begin() + k, res.end());
+  }
+  return res;
+}
+
+}  // namespace simplekv
+
+#endif  // QUERY_HPP_
@@ -0,0 +1,92 @@
+#ifndef RINGBUFFER_HPP_
+#define RINGBUFFER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace simplekv {
+
+// A bounded, lock-free, single producer / single consumer queue.
+//
+// One thread may call try_push and one (other) thread may call try_pop at
+// the same time without any locking. Several producers are fine as long as
+// something else (like the SimpleKV mutex) makes sure only one of them
+// pushes at a time.
+template <typename T>
+class RingBuffer {
+ public:
+  // Constructs an empty ring buffer
+  //
+  // Arguments:
+  // - capacity: the most elements the buffer will hold, rounded up to a
+  //             power of two
+  explicit RingBuffer(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  RingBuffer(const RingBuffer& other) = delete;
+  RingBuffer(RingBuffer&& other) = delete;
+  RingBuffer& operator=(const RingBuffer& other) = delete;
+  RingBuffer& operator=(RingBuffer&& other) = delete;
+  ~RingBuffer() = default;
+
+  // Adds an element to the back of the buffer. Producer only.
+  //
+  // Returns:
+  // - false if the buffer is full, the element is not added
+  // - true otherwise
+  bool try_push(T value) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == slots.size()) {
+      return false;
+    }
+    slots[t & mask] = std::move(value);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Removes the element at the front of the buffer. Consumer only.
+  //
+  // Returns:
+  // - nullopt if the buffer is empty
+  // - the oldest element otherwise
+  std::optional<T> try_pop() {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+    std::optional<T> res{std::move(slots[h & mask])};
+    head.store(h + 1, std::memory_order_release);
+    return res;
+  }
+
+  // Returns true iff the buffer currently has no elements
+  bool empty() const {
+    return head.load(std::memory_order_acquire) ==
+           tail.load(std::memory_order_acquire);
+  }
+
+  // Returns the most elements the buffer can hold
+  size_t capacity() const { return slots.size(); }
+
+ private:
+  std::vector<T> slots;
+  size_t mask;
+  // head and tail only ever grow, the slot is the position masked down.
+  // They live on separate cache lines so the producer and consumer don't
+  // fight over them.
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+}  // namespace simplekv
+
+#endif  // RINGBUFFER_HPP_
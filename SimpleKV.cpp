@@ -1,8 +1,14 @@
 #include "./SimpleKV.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 #include "SimpleKV.hpp"
@@ -11,9 +17,47 @@ using namespace std;
 
 namespace simplekv {
 
+namespace {
+
+// the id of the next object, see SimpleKV::id
+atomic<uint64_t> next_id{1};
+
+}  // namespace
+
+SimpleKV::SimpleKV()
+    : SimpleKV(make_shared<recursive_mutex>(), make_shared<StringPool>()) {}
+
+SimpleKV::SimpleKV(shared_ptr<recursive_mutex> shared_mtx,
+                   shared_ptr<StringPool> shared_pool)
+    : shared_mtx(move(shared_mtx)),
+      mtx(*this->shared_mtx),
+      shared_pool(move(shared_pool)),
+      pool(*this->shared_pool),
+      id(next_id++) {}
+
+SimpleKV::~SimpleKV() {
+  lock_guard<recursive_mutex> lock(mtx);
+  // spilled values only we hold let go of their records, clones may still
+  // be using the log
+  for (auto& pair : tiers) {
+    auto first_iter = kv_store.find(pair.first);
+    if (first_iter == kv_store.end() || first_iter->second.use_count() > 1 ||
+        pair.second.log.use_count() == 1) {
+      continue;
+    }
+    for (const auto& keypair : *first_iter->second) {
+      discard_spilled(pair.first, keypair.second);
+    }
+  }
+  // interned values have to let go of the shared pool under the lock
+  kv_store.clear();
+  value_indexes.clear();
+}
+
 // General Operations
 
 vector<string> SimpleKV::namespaces() {
+  lock_guard<recursive_mutex> lock(mtx);
   // need to iterate through the kvstore and return all namespaces
 
   vector<string> res{};
@@ -24,6 +68,7 @@ vector<string> SimpleKV::namespaces() {
 }
 
 vector<string> SimpleKV::keys(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
   // we need to iterate through namespaces in kvstore and return all key names
   // in that specific namespace
   vector<string> res{};
@@ -34,7 +79,7 @@ vector<string> SimpleKV::keys(const string& nspace) {
     // in that namespace and return all keys
     if (pair.first == nspace) {
       // iterate through the keys in that namespace and return all keys
-      for (const auto& keypair : pair.second) {
+      for (const auto& keypair : *pair.second) {
         // add to our new list res
         res.push_back(keypair.first);
       }
@@ -44,18 +89,20 @@ vector<string> SimpleKV::keys(const string& nspace) {
 }
 
 bool SimpleKV::ns_exists(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
   //use the find function to see if we can find the nspace. If we can, then we return true (i.e the end function will return false). If not it will return false. 
     return kv_store.find(nspace) != kv_store.end();
 }
 
 
 bool SimpleKV::key_exists(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
   // iterate through kvstore and check if the key exists
   for (const auto& pair : kv_store) {
     // if the nspace is found
     if (pair.first == nspace) {
       // then iterate through the keys in the nspace
-      for (const auto& keypair : pair.second) {
+      for (const auto& keypair : *pair.second) {
         // if we find the key, return true
         if (keypair.first == key) {
           return true;
@@ -69,6 +116,7 @@ bool SimpleKV::key_exists(const string& nspace, const string& key) {
 
 value_type_info SimpleKV::type(const std::string& nspace,
                                const std::string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
   // use the find function to store an iter to the namespace
   auto first_iter = kv_store.find(nspace);
   // now check if the namespace exists
@@ -77,7 +125,7 @@ value_type_info SimpleKV::type(const std::string& nspace,
     return value_type_info::none;
   }
   // search for the key in the namespace
-  auto& key_map = first_iter->second;
+  const auto& key_map = *first_iter->second;
   // use the find function to store an iter to the key
   auto key_iter = key_map.find(key);
   // if the key_iter is at the end of the key_map, return none
@@ -85,19 +133,30 @@ value_type_info SimpleKV::type(const std::string& nspace,
     return value_type_info::none;
   }
   // if we do find the key, check if list or string
-  if (holds_alternative<vector<string>>(key_iter->second)) {
+  if (holds_alternative<vector<string>>(*key_iter->second) ||
+      holds_alternative<CompressedList>(*key_iter->second) ||
+      holds_alternative<InternedList>(*key_iter->second)) {
     // if it is a list, then we return the list
     return value_type_info::list;
   }
-  if (holds_alternative<string>(key_iter->second)) {
+  if (holds_alternative<string>(*key_iter->second) ||
+      holds_alternative<CompressedString>(*key_iter->second) ||
+      holds_alternative<InternedString>(*key_iter->second)) {
     // if it is a string, then we return the string
     return value_type_info::string;
   }
+  // spilled values remember what they were, no need to read them back
+  if (holds_alternative<SpilledValue>(*key_iter->second)) {
+    return get<SpilledValue>(*key_iter->second).is_list
+               ? value_type_info::list
+               : value_type_info::string;
+  }
   // if the key is not a list or string, return none
   return value_type_info::none;
 }
 
 bool SimpleKV::del(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
   // iterate through our kvstore to get the namespace
   // instead of nested for loops lets try to use find
   auto first_iter = kv_store.find(nspace);
@@ -106,21 +165,27 @@ bool SimpleKV::del(const string& nspace, const string& key) {
     // if the namespace is at the end of the kv_store, then we return false
     return false;
   }
-  // if the namespace is found, then find the key
-  auto& key_map = first_iter->second;
-  auto key_iter = key_map.find(key);
+  // if the namespace is found, then find the key. Look in the keys as they
+  // are, they only have to be copied away from a clone if we delete one.
+  auto key_iter = first_iter->second->find(key);
 
   // if the key is not found, then return false
-  if (key_iter == key_map.end()) {
+  if (key_iter == first_iter->second->end()) {
     return false;
   }
   // if the key is found, then we delete the key
+  auto& key_map = writable(first_iter->second, &key_iter);
+  unindex_value(nspace, key, *key_iter->second);
+  discard_spilled(nspace, key_iter->second);
   key_map.erase(key_iter);
+  generation++;
+  forget_list_bytes(nspace, key);
   // if after erasing the key, our namespace is empty, we should delete the
   // namespace
   if (key_map.empty()) {
     kv_store.erase(first_iter);
   }
+  publish(change_type::del, nspace, key, "");
   // return true if the key was deleted
   return true;
 }
@@ -128,15 +193,25 @@ bool SimpleKV::del(const string& nspace, const string& key) {
 // string operations
 
 optional<string> SimpleKV::sget(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // iterate through our kvstore to get the namespace
   for (const auto& pair : kv_store) {
     if (pair.first == nspace) {
       // then iterate through the keys in that namespace
-      for (const auto& keypair : pair.second) {
+      for (const auto& keypair : *pair.second) {
         // if we find the key, then return the value
         if (keypair.first == key) {
-          if (std::holds_alternative<std::string>(keypair.second)) {
-            return std::get<std::string>(keypair.second);
+          if (std::holds_alternative<std::string>(*keypair.second)) {
+            return std::get<std::string>(*keypair.second);
+          }
+          // compressed strings have to be expanded before we hand them out
+          if (holds_alternative<CompressedString>(*keypair.second)) {
+            const auto& packed = get<CompressedString>(*keypair.second);
+            return decompress_block(packed.data, packed.raw_size);
+          }
+          if (holds_alternative<InternedString>(*keypair.second)) {
+            return get<InternedString>(*keypair.second).str();
           }
           return nullopt;
         }
@@ -149,42 +224,65 @@ optional<string> SimpleKV::sget(const string& nspace, const string& key) {
 void SimpleKV::sset(const string& nspace,
                     const string& key,
                     const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, false);
   // use the find function to store an iter to the namespace
   auto first_iter = kv_store.find(nspace);
   // if the namespace is not at the end of the kv_store then we can continue
   if (first_iter != kv_store.end()) {
     // this means that we've found the namespace, so we should check to see if
     // the key exists
-    auto& key_map = first_iter->second;
     // use the find function to store an iter to the key
-    auto key_iter = key_map.find(key);
-    if (key_iter != key_map.end()) {
+    auto key_iter = first_iter->second->find(key);
+    bool found = key_iter != first_iter->second->end();
+    auto& key_map = found ? writable(first_iter->second, &key_iter)
+                          : writable(first_iter->second);
+    if (found) {
       // if the key is found, then we set the value
-      key_iter->second = value;
+      unindex_value(nspace, key, *key_iter->second);
+      discard_spilled(nspace, key_iter->second);
+      forget_list_bytes(nspace, key);
+      key_iter->second = make_string_value(nspace, value);
     } else {
       // otherwise we add the key and value to the namespace
-      key_map[key] = value;
+      key_map[key] = make_string_value(nspace, value);
     }
   } else {
     // otherwase we need to create a new namespace and key-value pair
-    kv_store[nspace] = {{key, value}};
+    kv_store[nspace] = make_shared<KeyMap>(
+        KeyMap{{key, make_string_value(nspace, value)}});
   }
+  if (auto* index = index_for(nspace)) {
+    index->add_string(key, value);
+  }
+  tier_written(nspace, value.size());
+  publish(change_type::set, nspace, key, value);
 }
 
 // list operations
 
 ssize_t SimpleKV::llen(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // iterate through our kvstore to get the namespace
   for (const auto& pair : kv_store) {
     if (pair.first == nspace) {
       // then lets find the key in that nspace
-      for (const auto& keypair : pair.second) {
+      for (const auto& keypair : *pair.second) {
         if (keypair.first == key) {
           // if we find the key then we return the size of the associated list
           // and -1 if its a string
-          if (holds_alternative<vector<string>>(keypair.second)) {
+          if (holds_alternative<vector<string>>(*keypair.second)) {
+            return static_cast<ssize_t>(
+                get<vector<string>>(*keypair.second).size());
+          }
+          if (holds_alternative<CompressedList>(*keypair.second)) {
             return static_cast<ssize_t>(
-                get<vector<string>>(keypair.second).size());
+                get<CompressedList>(*keypair.second).size());
+          }
+          if (holds_alternative<InternedList>(*keypair.second)) {
+            return static_cast<ssize_t>(
+                get<InternedList>(*keypair.second).size());
           }
           return -1;
         }
@@ -197,6 +295,8 @@ ssize_t SimpleKV::llen(const string& nspace, const string& key) {
 optional<string> SimpleKV::lindex(const string& nspace,
                                   const string& key,
                                   size_t index) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // use the find function to store an iter to the namespace
   auto first_iter = kv_store.find(nspace);
   // if the namespace is not at the end of the kv_store then we can continue
@@ -205,7 +305,7 @@ optional<string> SimpleKV::lindex(const string& nspace,
     return std::nullopt;
   }
   // search for the key in the namespace
-  auto& key_map = first_iter->second;
+  const auto& key_map = *first_iter->second;
   // use the find function to store an iter to the key
   auto key_iter = key_map.find(key);
   if (key_iter == key_map.end()) {
@@ -213,31 +313,58 @@ optional<string> SimpleKV::lindex(const string& nspace,
     return std::nullopt;
   }
   // if we do find the key, check if list
-  if (holds_alternative<vector<string>>(key_iter->second)) {
+  if (holds_alternative<vector<string>>(*key_iter->second)) {
     // get the list and store it in a const
-    const auto& list = get<vector<string>>(key_iter->second);
+    const auto& list = get<vector<string>>(*key_iter->second);
     if (index < list.size()) {
       // return the value at the specified index
       return list[index];
     }
   }
+  // compressed lists only have to expand the chunk holding the index
+  if (holds_alternative<CompressedList>(*key_iter->second)) {
+    const auto& list = get<CompressedList>(*key_iter->second);
+    if (index < list.size()) {
+      return list.at(index);
+    }
+  }
+  if (holds_alternative<InternedList>(*key_iter->second)) {
+    const auto& list = get<InternedList>(*key_iter->second);
+    if (index < list.size()) {
+      return list[index].str();
+    }
+  }
   // if the key is not a list or the index is out of bounds, return nullopt
   return std::nullopt;
 }
 
 optional<vector<string>> SimpleKV::lmembers(const string& nspace,
                                             const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // iterate through our kvstore to get the namespace
   for (const auto& pair : kv_store) {
     if (pair.first == nspace) {
       // then lets find the key in that nspace
-      for (const auto& keypair : pair.second) {
+      for (const auto& keypair : *pair.second) {
         if (keypair.first == key) {
           // if we find the key, then we check to see if it is a list
           if (std::holds_alternative<std::vector<std::string>>(
-                  keypair.second)) {
+                  *keypair.second)) {
             // if it is a list, then we return the list
-            return std::get<std::vector<std::string>>(keypair.second);
+            return std::get<std::vector<std::string>>(*keypair.second);
+          }
+          if (holds_alternative<CompressedList>(*keypair.second)) {
+            return get<CompressedList>(*keypair.second).members();
+          }
+          if (holds_alternative<InternedList>(*keypair.second)) {
+            const auto& list = get<InternedList>(*keypair.second);
+            vector<string> res;
+            res.reserve(list.size());
+            for (const auto& elem : list) {
+              res.push_back(elem.str());
+            }
+            return res;
           }
           // otherwise we return nullopt
           return nullopt;
@@ -252,88 +379,141 @@ bool SimpleKV::lset(const string& nspace,
                     const string& key,
                     size_t index,
                     const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // if the index is negative, then we return false
   if (index < 0) {
     return false;
   }
-  // iterate through our kvstore to get the namespace
-  for (auto& pair : kv_store) {
-    if (pair.first == nspace) {
-      // lets fine the key in that namespace
-      for (auto& keypair : pair.second) {
-        if (keypair.first == key) {
-          // then if we have the key, let's check to see if it is a list
-          if (std::holds_alternative<std::vector<std::string>>(
-                  keypair.second)) {
-            // if it is a list, then we check to see if the index is in bounds
-            if (index <
-                std::get<std::vector<std::string>>(keypair.second).size()) {
-              // if it is in bounds, then we set the value at that index
-              std::get<std::vector<std::string>>(keypair.second).at(index) =
-                  value;
-              return true;
-            } 
-              // otherwise we return false
-              return false;
-          }
-          // otherwise we return false
-          return false;
-        }
-      }
+  // use the find function to store an iter to the namespace
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return false;
+  }
+  // find the key in the keys as they are, and only copy them away from a
+  // clone once we know the index is good
+  auto key_iter = first_iter->second->find(key);
+  if (key_iter == first_iter->second->end()) {
+    return false;
+  }
+  size_t size = 0;
+  if (holds_alternative<vector<string>>(*key_iter->second)) {
+    size = get<vector<string>>(*key_iter->second).size();
+  } else if (holds_alternative<CompressedList>(*key_iter->second)) {
+    size = get<CompressedList>(*key_iter->second).size();
+  } else if (holds_alternative<InternedList>(*key_iter->second)) {
+    size = get<InternedList>(*key_iter->second).size();
+  }
+  // strings have no elements, so this covers them too
+  if (index >= size) {
+    return false;
+  }
+  writable(first_iter->second, &key_iter);
+  if (std::holds_alternative<std::vector<std::string>>(*key_iter->second)) {
+    // set the value at that index
+    auto& elem =
+        std::get<std::vector<std::string>>(key_iter->second.mut()).at(index);
+    if (index_for(nspace) != nullptr) {
+      reindex_element(nspace, key, elem, value);
+    }
+    elem = value;
+    forget_list_bytes(nspace, key);
+  } else if (holds_alternative<CompressedList>(*key_iter->second)) {
+    auto& list = get<CompressedList>(key_iter->second.mut());
+    if (index_for(nspace) != nullptr) {
+      reindex_element(nspace, key, list.at(index), value);
     }
+    list.set(index, value);
+  } else {
+    auto& list = get<InternedList>(key_iter->second.mut());
+    if (index_for(nspace) != nullptr) {
+      reindex_element(nspace, key, list[index].str(), value);
+    }
+    list[index] = pool.intern(value);
+    forget_list_bytes(nspace, key);
   }
-
-  return false;
+  publish(change_type::lset, nspace, key, value);
+  return true;
 }
 
 bool SimpleKV::lpush(const string& nspace,
                      const string& key,
                      const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // use the find function to get the namespace and set it to an iter
   auto nspace_iter = kv_store.find(nspace);
   // if the namespace is not at the end of the kv_store then we can continue
   if (nspace_iter != kv_store.end()) {
-    // we've found the namespace, so let's look for the key using find, first
-    // let's set the key_map to a reference
-    auto& key_map = nspace_iter->second;
-    auto key_iter = key_map.find(key);
-    // if the key is not at the end of the key_map then we can continue
-    if (key_iter != key_map.end()) {
-      if (holds_alternative<vector<string>>(key_iter->second)) {
+    // we've found the namespace, so let's look for the key using find
+    auto key_iter = nspace_iter->second->find(key);
+    bool found = key_iter != nspace_iter->second->end();
+    // the key must exist but it isn't a list (its a string), nothing
+    // changes so there is no need to copy the keys away from a clone
+    if (found && !holds_list(*key_iter->second)) {
+      return false;
+    }
+    // now let's set the key_map to a reference
+    auto& key_map = found ? writable(nspace_iter->second, &key_iter)
+                          : writable(nspace_iter->second);
+    // if the key exists then we can continue
+    if (found) {
+      if (holds_alternative<vector<string>>(*key_iter->second)) {
         // get the list
-        get<vector<string>>(key_iter->second)
-            .insert(get<vector<string>>(key_iter->second).begin(), value);
+        auto& list = get<vector<string>>(key_iter->second.mut());
+        list.insert(list.begin(), value);
+        pushed(change_type::lpush, nspace, key, value);
+        return true;
+      }
+      if (holds_alternative<CompressedList>(*key_iter->second)) {
+        get<CompressedList>(key_iter->second.mut()).push_front(value);
+        pushed(change_type::lpush, nspace, key, value);
+        return true;
+      }
+      if (holds_alternative<InternedList>(*key_iter->second)) {
+        auto& list = get<InternedList>(key_iter->second.mut());
+        list.insert(list.begin(), pool.intern(value));
+        pushed(change_type::lpush, nspace, key, value);
         return true;
       }
         // the key must exist but it isn't a list (its a string)
         return false;
     }
     // otherwise the key doesn't exist, so we create a list
-    key_map[key] = vector<string>{value};
+    key_map[key] = make_list_value(nspace, value);
   }
   // now if the namespace doesn't exist we have to create a new namespace, key
   // and list
   else {
-    kv_store[nspace] = {{key, vector<string>{value}}};
+    kv_store[nspace] =
+        make_shared<KeyMap>(KeyMap{{key, make_list_value(nspace, value)}});
   }
+  pushed(change_type::lpush, nspace, key, value);
   return true;
 }
 
 optional<string> SimpleKV::lpop(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // trying to use the find function to find the namespace and store it in a
   // iter
   auto first_iter = kv_store.find(nspace);
   // if the namespace is not at the end of the kv_store then we can continue
   if (first_iter != kv_store.end()) {
-    auto& key_map = first_iter->second;
     // trying to use the find function to find the key and store it in another
     // iter
-    auto second_iter = key_map.find(key);
+    auto second_iter = first_iter->second->find(key);
+    // nothing to pop, so no need to copy the keys away from a clone
+    if (second_iter == first_iter->second->end() ||
+        !holds_list(*second_iter->second)) {
+      return std::nullopt;
+    }
+    auto& key_map = writable(first_iter->second, &second_iter);
     // if the key is not at the end of the key_map then we can continue
     if (second_iter != key_map.end() &&
-        holds_alternative<std::vector<std::string>>(second_iter->second)) {
+        holds_alternative<std::vector<std::string>>(*second_iter->second)) {
       // get the list
-      auto& list = get<std::vector<std::string>>(second_iter->second);
+      auto& list = get<std::vector<std::string>>(second_iter->second.mut());
       // if the list is empty, pop the value and erase the key
       if (!list.empty()) {
         // pop the value
@@ -343,13 +523,45 @@ optional<string> SimpleKV::lpop(const string& nspace, const string& key) {
         // if the list is empty, erase the key
         if (list.empty()) {
           key_map.erase(second_iter);
+          generation++;
           if (key_map.empty()) {
             kv_store.erase(first_iter);
           }
         }
+        popped(change_type::lpop, nspace, key, popValue);
         return popValue;
       }
     }
+    // compressed lists are never empty, they are deleted when they empty out
+    if (second_iter != key_map.end() &&
+        holds_alternative<CompressedList>(*second_iter->second)) {
+      auto& list = get<CompressedList>(second_iter->second.mut());
+      string popValue = list.pop_front();
+      if (list.size() == 0) {
+        key_map.erase(second_iter);
+        generation++;
+        if (key_map.empty()) {
+          kv_store.erase(first_iter);
+        }
+      }
+      popped(change_type::lpop, nspace, key, popValue);
+      return popValue;
+    }
+    if (second_iter != key_map.end() &&
+        holds_alternative<InternedList>(*second_iter->second)) {
+      auto& list = get<InternedList>(second_iter->second.mut());
+      string popValue = list.front().str();
+      list.erase(list.begin());
+      if (list.empty()) {
+        key_map.erase(second_iter);
+        generation++;
+        if (key_map.empty()) {
+          kv_store.erase(first_iter);
+        }
+      }
+      popped(change_type::lpop, nspace, key, popValue);
+      return popValue;
+    }
   }
   return std::nullopt;
 }
@@ -357,44 +569,75 @@ optional<string> SimpleKV::lpop(const string& nspace, const string& key) {
 bool SimpleKV::rpush(const string& nspace,
                      const string& key,
                      const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // lets use find to find the namespace
   auto first_iter = kv_store.find(nspace);
   // if the namespace is not at the end of the kv_store then we can continue
   if (first_iter != kv_store.end()) {
-    auto& key_map = first_iter->second;
-    // now lets find the key in that key_map and store it in another iter
-    auto second_iter = key_map.find(key);
+    // now lets find the key in that namespace and store it in another iter
+    auto second_iter = first_iter->second->find(key);
+    bool found = second_iter != first_iter->second->end();
+    // the key must exist but it isn't a list, leave the keys shared
+    if (found && !holds_list(*second_iter->second)) {
+      return false;
+    }
+    auto& key_map = found ? writable(first_iter->second, &second_iter)
+                          : writable(first_iter->second);
     // if the key exists, and the value is a list, then we can continue
-    if (second_iter != key_map.end()) {
-      if (holds_alternative<vector<string>>(second_iter->second)) {
+    if (found) {
+      if (holds_alternative<vector<string>>(*second_iter->second)) {
         // get the list
-        get<vector<string>>(second_iter->second).push_back(value);
+        get<vector<string>>(second_iter->second.mut()).push_back(value);
+        pushed(change_type::rpush, nspace, key, value);
         return true;
         // if the list is empty, push the value and erase the key
       }
+      if (holds_alternative<CompressedList>(*second_iter->second)) {
+        get<CompressedList>(second_iter->second.mut()).push_back(value);
+        pushed(change_type::rpush, nspace, key, value);
+        return true;
+      }
+      if (holds_alternative<InternedList>(*second_iter->second)) {
+        get<InternedList>(second_iter->second.mut())
+            .push_back(pool.intern(value));
+        pushed(change_type::rpush, nspace, key, value);
+        return true;
+      }
       // the key must exist but it isn't a list
       return false;
     }
     // the key doesn't exist, so we create a list and push the value
-    key_map[key] = vector<string>{value};
+    key_map[key] = make_list_value(nspace, value);
+    pushed(change_type::rpush, nspace, key, value);
     return true;
   }
   // the namespace doesn't exist, so we create a new namespace, key, and list
-  kv_store[nspace] = {{key, vector<string>{value}}};
+  kv_store[nspace] =
+      make_shared<KeyMap>(KeyMap{{key, make_list_value(nspace, value)}});
+  pushed(change_type::rpush, nspace, key, value);
   return true;
 }
 
 optional<string> SimpleKV::rpop(const string& nspace, const string& key) {
+  lock_guard<recursive_mutex> lock(mtx);
+  tier_access(nspace, key, true);
   // lets use the find function and store that on an iter
   auto first_iter = kv_store.find(nspace);
   // if that nspace isn't at the back of the kv_store then we can continue
   if (first_iter != kv_store.end()) {
-    auto second_iter = first_iter->second.find(key);
+    auto second_iter = first_iter->second->find(key);
+    // nothing to pop, so no need to copy the keys away from a clone
+    if (second_iter == first_iter->second->end() ||
+        !holds_list(*second_iter->second)) {
+      return nullopt;
+    }
+    auto& key_map = writable(first_iter->second, &second_iter);
     // if the key is not at the back of the key_map then we can continue
-    if (second_iter != first_iter->second.end() &&
-        holds_alternative<vector<string>>(second_iter->second)) {
+    if (second_iter != key_map.end() &&
+        holds_alternative<vector<string>>(*second_iter->second)) {
       // get the list
-      auto& list = get<vector<string>>(second_iter->second);
+      auto& list = get<vector<string>>(second_iter->second.mut());
       // if the list is not empty, pop the value and erase the key
       if (!list.empty()) {
         // pop the value
@@ -403,20 +646,48 @@ optional<string> SimpleKV::rpop(const string& nspace, const string& key) {
         list.pop_back();
         // if the list is empty, erase the key
         if (list.empty()) {
-          first_iter->second.erase(second_iter);
+          key_map.erase(second_iter);
+          generation++;
         }
         // if the namespace would also be empty, erase the namespace
-        if (first_iter->second.empty()) {
+        if (key_map.empty()) {
           kv_store.erase(first_iter);
-          if (kv_store.empty()) {
-            kv_store.erase(first_iter);
-          }
         }
+        popped(change_type::rpop, nspace, key, pop);
         return pop;
       }
       // if either the namespace or the key is not found, return nullopt
       return nullopt;
     }
+    if (second_iter != key_map.end() &&
+        holds_alternative<CompressedList>(*second_iter->second)) {
+      auto& list = get<CompressedList>(second_iter->second.mut());
+      string pop = list.pop_back();
+      if (list.size() == 0) {
+        key_map.erase(second_iter);
+        generation++;
+        if (key_map.empty()) {
+          kv_store.erase(first_iter);
+        }
+      }
+      popped(change_type::rpop, nspace, key, pop);
+      return pop;
+    }
+    if (second_iter != key_map.end() &&
+        holds_alternative<InternedList>(*second_iter->second)) {
+      auto& list = get<InternedList>(second_iter->second.mut());
+      string pop = list.back().str();
+      list.pop_back();
+      if (list.empty()) {
+        key_map.erase(second_iter);
+        generation++;
+        if (key_map.empty()) {
+          kv_store.erase(first_iter);
+        }
+      }
+      popped(change_type::rpop, nspace, key, pop);
+      return pop;
+    }
   }
   return nullopt;
 }
@@ -425,12 +696,28 @@ optional<vector<string>> SimpleKV::lunion(const string& nspace1,
                                           const string& key1,
                                           const string& nspace2,
                                           const string& key2) {
+  lock_guard<recursive_mutex> lock(mtx);
   // check the types of the keys and if they are strings, return nullopt
   auto type1 = type(nspace1, key1);
   auto type2 = type(nspace2, key2);
   if (type1 == value_type_info::string || type2 == value_type_info::string) {
     return nullopt;
   }
+  // interned lists can be compared by id without hashing the characters
+  const auto* interned1 = find_interned_list(nspace1, key1);
+  const auto* interned2 = find_interned_list(nspace2, key2);
+  if (interned1 != nullptr && interned2 != nullptr) {
+    unordered_set<const void*> seen;
+    vector<string> unionList;
+    for (const auto* list : {interned1, interned2}) {
+      for (const auto& elem : *list) {
+        if (seen.insert(elem.id()).second) {
+          unionList.push_back(elem.str());
+        }
+      }
+    }
+    return unionList;
+  }
   // now that we know that they are not strings, we can get the lists
   auto list1 = lmembers(nspace1, key1).value_or(vector<string>{});
   auto list2 = lmembers(nspace2, key2).value_or(vector<string>{});
@@ -447,6 +734,25 @@ optional<vector<string>> SimpleKV::linter(const string& nspace1,
                                           const string& key1,
                                           const string& nspace2,
                                           const string& key2) {
+  lock_guard<recursive_mutex> lock(mtx);
+  // interned lists can be compared by id without hashing the characters
+  const auto* interned1 = find_interned_list(nspace1, key1);
+  const auto* interned2 = find_interned_list(nspace2, key2);
+  if (interned1 != nullptr && interned2 != nullptr) {
+    unordered_set<const void*> interSet;
+    for (const auto& elem : *interned2) {
+      interSet.insert(elem.id());
+    }
+    unordered_set<const void*> addedSet;
+    vector<string> interList;
+    for (const auto& elem : *interned1) {
+      if (interSet.find(elem.id()) != interSet.end() &&
+          addedSet.insert(elem.id()).second) {
+        interList.push_back(elem.str());
+      }
+    }
+    return interList;
+  }
   // using the lmembers function to get the lists
   auto list1 = lmembers(nspace1, key1);
   auto list2 = lmembers(nspace2, key2);
@@ -478,12 +784,31 @@ optional<vector<string>> SimpleKV::ldiff(const string& nspace1,
                                          const string& key1,
                                          const string& nspace2,
                                          const string& key2) {
+  lock_guard<recursive_mutex> lock(mtx);
   // check the types of the keys and if they are strings, return nullopt
   auto type1 = type(nspace1, key1);
   auto type2 = type(nspace2, key2);
   if (type1 == value_type_info::string || type2 == value_type_info::string) {
     return nullopt;
   }
+  // interned lists can be compared by id without hashing the characters
+  const auto* interned1 = find_interned_list(nspace1, key1);
+  const auto* interned2 = find_interned_list(nspace2, key2);
+  if (interned1 != nullptr && interned2 != nullptr) {
+    unordered_set<const void*> diffSet;
+    for (const auto& elem : *interned2) {
+      diffSet.insert(elem.id());
+    }
+    unordered_set<const void*> addedSet;
+    vector<string> diffList;
+    for (const auto& elem : *interned1) {
+      if (diffSet.find(elem.id()) == diffSet.end() &&
+          addedSet.insert(elem.id()).second) {
+        diffList.push_back(elem.str());
+      }
+    }
+    return diffList;
+  }
   // now that we know that they are not strings, we can get the lists
   auto list1 = lmembers(nspace1, key1).value_or(vector<string>{});
   auto list2 = lmembers(nspace2, key2).value_or(vector<string>{});
@@ -504,5 +829,575 @@ optional<vector<string>> SimpleKV::ldiff(const string& nspace1,
   }
   return diffList;
 }
+
+// blocking operations
+
+optional<string> SimpleKV::blpop(const string& nspace,
+                                 const string& key,
+                                 chrono::milliseconds timeout) {
+  return blocking_pop(nspace, key, timeout, true);
+}
+
+optional<string> SimpleKV::brpop(const string& nspace,
+                                 const string& key,
+                                 chrono::milliseconds timeout) {
+  return blocking_pop(nspace, key, timeout, false);
+}
+
+optional<string> SimpleKV::blocking_pop(const string& nspace,
+                                        const string& key,
+                                        chrono::milliseconds timeout,
+                                        bool front) {
+  unique_lock<recursive_mutex> lock(mtx);
+  auto deadline = chrono::steady_clock::now() + timeout;
+  // take a place in line for this list, waiters are served in the order
+  // they arrived
+  uint64_t ticket = next_ticket++;
+  auto wkey = waiter_key(nspace, key);
+  auto& waiting = waiters[wkey];
+  waiting.line.push_back(ticket);
+  // we can go once we are at the front of the line and the key exists. Lists
+  // are deleted when they are emptied so an existing list always has a value,
+  // and if it is a string the pop below fails right away.
+  bool ready = waiting.ready.wait_until(lock, deadline, [&] {
+    return waiting.line.front() == ticket &&
+           type(nspace, key) != value_type_info::none;
+  });
+  optional<string> res = nullopt;
+  if (ready) {
+    res = front ? lpop(nspace, key) : rpop(nspace, key);
+  }
+  // leave the line, whether we got a value or timed out
+  for (auto iter = waiting.line.begin(); iter != waiting.line.end(); ++iter) {
+    if (*iter == ticket) {
+      waiting.line.erase(iter);
+      break;
+    }
+  }
+  if (waiting.line.empty()) {
+    waiters.erase(wkey);
+  } else {
+    // the next waiter may be able to go now that we are out of the way
+    waiting.ready.notify_all();
+  }
+  return res;
+}
+
+// compression
+
+void SimpleKV::enable_compression(const string& nspace, size_t threshold) {
+  lock_guard<recursive_mutex> lock(mtx);
+  compression[nspace] = threshold;
+  generation++;
+}
+
+void SimpleKV::disable_compression(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  compression.erase(nspace);
+  list_bytes.erase(nspace);
+  generation++;
+}
+
+CompressionStats SimpleKV::compression_stats(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  CompressionStats stats;
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return stats;
+  }
+  for (const auto& keypair : *first_iter->second) {
+    stats.values++;
+    if (holds_alternative<CompressedString>(*keypair.second)) {
+      const auto& packed = get<CompressedString>(*keypair.second);
+      stats.compressed_values++;
+      stats.raw_bytes += packed.raw_size;
+      stats.stored_bytes += packed.data.size();
+    } else if (holds_alternative<CompressedList>(*keypair.second)) {
+      const auto& list = get<CompressedList>(*keypair.second);
+      stats.compressed_values++;
+      stats.raw_bytes += list.raw_bytes();
+      stats.stored_bytes += list.stored_bytes();
+    }
+  }
+  return stats;
+}
+
+// interning
+
+void SimpleKV::enable_interning(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  interning.insert(nspace);
+  generation++;
+}
+
+void SimpleKV::disable_interning(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  interning.erase(nspace);
+  generation++;
+}
+
+size_t SimpleKV::interned_strings() {
+  lock_guard<recursive_mutex> lock(mtx);
+  return pool.size();
+}
+
+// cloning
+
+unique_ptr<SimpleKV> SimpleKV::clone() {
+  return clone_of(nullopt);
+}
+
+unique_ptr<SimpleKV> SimpleKV::clone_namespace(const string& nspace) {
+  return clone_of(nspace);
+}
+
+// value indexes
+
+void SimpleKV::enable_value_index(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  if (value_indexes.find(nspace) != value_indexes.end()) {
+    return;
+  }
+  value_indexes[nspace] = make_shared<ValueIndex>();
+  generation++;
+  rebuild_index(nspace);
+}
+
+void SimpleKV::disable_value_index(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  value_indexes.erase(nspace);
+  generation++;
+}
+
+vector<string> SimpleKV::find_by_value(const string& nspace,
+                                       const string& value) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto index_iter = value_indexes.find(nspace);
+  if (index_iter != value_indexes.end()) {
+    return index_iter->second->keys_with_value(value);
+  }
+  // no index, so look at every key
+  vector<string> res{};
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return res;
+  }
+  for (const auto& keypair : *first_iter->second) {
+    auto str = string_of(nspace, *keypair.second);
+    if (str && *str == value) {
+      res.push_back(keypair.first);
+    }
+  }
+  return res;
+}
+
+vector<string> SimpleKV::find_lists_containing(const string& nspace,
+                                               const string& elem) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto index_iter = value_indexes.find(nspace);
+  if (index_iter != value_indexes.end()) {
+    return index_iter->second->lists_containing(elem);
+  }
+  // no index, so look through every list
+  vector<string> res{};
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return res;
+  }
+  for (const auto& keypair : *first_iter->second) {
+    if (type(nspace, keypair.first) != value_type_info::list) {
+      continue;
+    }
+    auto elems = elements_of(nspace, *keypair.second);
+    if (find(elems.begin(), elems.end(), elem) != elems.end()) {
+      res.push_back(keypair.first);
+    }
+  }
+  return res;
+}
+
+// change feed
+
+shared_ptr<Subscription> SimpleKV::subscribe(const string& nspace,
+                                             const string& key_prefix,
+                                             size_t capacity) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto sub = make_shared<Subscription>(nspace, key_prefix, capacity);
+  subscribers.push_back(sub);
+  return sub;
+}
+
+bool SimpleKV::unsubscribe(const shared_ptr<Subscription>& sub) {
+  lock_guard<recursive_mutex> lock(mtx);
+  for (auto iter = subscribers.begin(); iter != subscribers.end(); ++iter) {
+    if (*iter == sub) {
+      subscribers.erase(iter);
+      return true;
+    }
+  }
+  return false;
+}
+
+// private helpers
+
+unique_ptr<SimpleKV> SimpleKV::clone_of(const optional<string>& only) {
+  lock_guard<recursive_mutex> lock(mtx);
+  unique_ptr<SimpleKV> copy(new SimpleKV(shared_mtx, shared_pool));
+  // our namespaces are about to be shared
+  generation++;
+  auto wanted = [&](const string& nspace) { return !only || *only == nspace; };
+  // namespaces and indexes are shared, writable() and index_for() copy
+  // them once either side changes them
+  for (const auto& pair : kv_store) {
+    if (wanted(pair.first)) {
+      copy->kv_store.insert(pair);
+    }
+  }
+  for (const auto& pair : value_indexes) {
+    if (wanted(pair.first)) {
+      copy->value_indexes.insert(pair);
+    }
+  }
+  for (const auto& pair : compression) {
+    if (wanted(pair.first)) {
+      copy->compression.insert(pair);
+    }
+  }
+  for (const auto& nspace : interning) {
+    if (wanted(nspace)) {
+      copy->interning.insert(nspace);
+    }
+  }
+  for (const auto& pair : typed_namespaces) {
+    if (wanted(pair.first)) {
+      copy->typed_namespaces.emplace(pair.first, pair.second->clone());
+    }
+  }
+  // the copy starts its own sweeps, but spills to the same log
+  for (const auto& pair : tiers) {
+    if (wanted(pair.first)) {
+      Tier tier;
+      tier.log = pair.second.log;
+      tier.memory_budget = pair.second.memory_budget;
+      tier.min_value_bytes = pair.second.min_value_bytes;
+      copy->tiers.emplace(pair.first, move(tier));
+    }
+  }
+  return copy;
+}
+
+SimpleKV::KeyMap& SimpleKV::writable(shared_ptr<KeyMap>& keys) {
+  // every clone holding the keys runs under our lock, so nobody can take
+  // or drop a reference while we look
+  if (keys.use_count() > 1) {
+    // the values themselves stay shared, this only copies a pointer per key
+    keys = make_shared<KeyMap>(*keys);
+    generation++;
+  }
+  return *keys;
+}
+
+SimpleKV::KeyMap& SimpleKV::writable(shared_ptr<KeyMap>& keys,
+                                     KeyMap::iterator* key_iter) {
+  if (keys.use_count() == 1) {
+    return *keys;
+  }
+  // the iterator points into the shared keys, find the key again in ours
+  string key = (*key_iter)->first;
+  auto& key_map = writable(keys);
+  *key_iter = key_map.find(key);
+  return key_map;
+}
+
+bool SimpleKV::holds_list(const ValueType& value) {
+  return holds_alternative<vector<string>>(value) ||
+         holds_alternative<CompressedList>(value) ||
+         holds_alternative<InternedList>(value);
+}
+
+string SimpleKV::waiter_key(const string& nspace, const string& key) {
+  // the null byte keeps ("ab", "c") and ("a", "bc") apart
+  string wkey = nspace;
+  wkey.push_back('\0');
+  wkey += key;
+  return wkey;
+}
+
+SimpleKV::ValueType SimpleKV::make_string_value(const string& nspace,
+                                                const string& value) {
+  auto iter = compression.find(nspace);
+  if (iter != compression.end() && value.size() >= iter->second) {
+    // keep the string uncompressed if it doesn't shrink, there is no point
+    // paying to expand it on every read
+    string packed = compress_block(value);
+    if (packed.size() < value.size()) {
+      return CompressedString{move(packed), value.size()};
+    }
+  }
+  if (interning.find(nspace) != interning.end()) {
+    return pool.intern(value);
+  }
+  return value;
+}
+
+SimpleKV::ValueType SimpleKV::make_list_value(const string& nspace,
+                                              const string& value) {
+  if (interning.find(nspace) != interning.end()) {
+    return InternedList{pool.intern(value)};
+  }
+  return vector<string>{value};
+}
+
+const SimpleKV::InternedList* SimpleKV::find_interned_list(
+    const string& nspace, const string& key) {
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return nullptr;
+  }
+  auto key_iter = first_iter->second->find(key);
+  if (key_iter == first_iter->second->end() ||
+      !holds_alternative<InternedList>(*key_iter->second)) {
+    return nullptr;
+  }
+  return &get<InternedList>(*key_iter->second);
+}
+
+void SimpleKV::maybe_compress_list(const string& nspace,
+                                   const string& key,
+                                   size_t pushed_bytes) {
+  // the common case is no compression at all, keep that to one branch
+  if (compression.empty()) {
+    return;
+  }
+  auto iter = compression.find(nspace);
+  if (iter == compression.end()) {
+    return;
+  }
+  // the push that called us already made the keys writable
+  auto& key_map = *kv_store[nspace];
+  auto key_iter = key_map.find(key);
+  if (key_iter == key_map.end()) {
+    return;
+  }
+  auto& slot = key_iter->second;
+  const auto& value = *slot;
+  auto& counts = list_bytes[nspace];
+  if (!holds_alternative<vector<string>>(value) &&
+      !holds_alternative<InternedList>(value)) {
+    counts.erase(key);
+    return;
+  }
+  auto count_iter = counts.find(key);
+  if (count_iter == counts.end()) {
+    // a new list, or one that was stored or changed before we were
+    // counting, so add it up once. That already includes the push.
+    count_iter = counts.emplace(key, value_bytes(value)).first;
+  } else {
+    count_iter->second += pushed_bytes;
+  }
+  if (count_iter->second < iter->second) {
+    return;
+  }
+  counts.erase(count_iter);
+  if (holds_alternative<InternedList>(value)) {
+    const auto& list = get<InternedList>(value);
+    vector<string> plain;
+    plain.reserve(list.size());
+    for (const auto& elem : list) {
+      plain.push_back(elem.str());
+    }
+    slot = CompressedList(plain);
+    return;
+  }
+  CompressedList packed(get<vector<string>>(value));
+  slot = move(packed);
+}
+
+void SimpleKV::list_shrank(const string& nspace,
+                           const string& key,
+                           size_t popped_bytes) {
+  if (list_bytes.empty()) {
+    return;
+  }
+  auto first_iter = list_bytes.find(nspace);
+  if (first_iter == list_bytes.end()) {
+    return;
+  }
+  auto count_iter = first_iter->second.find(key);
+  if (count_iter == first_iter->second.end()) {
+    return;
+  }
+  // an emptied list is erased, so its count goes with it
+  if (count_iter->second <= popped_bytes) {
+    first_iter->second.erase(count_iter);
+  } else {
+    count_iter->second -= popped_bytes;
+  }
+}
+
+void SimpleKV::forget_list_bytes(const string& nspace, const string& key) {
+  if (list_bytes.empty()) {
+    return;
+  }
+  auto first_iter = list_bytes.find(nspace);
+  if (first_iter != list_bytes.end()) {
+    first_iter->second.erase(key);
+  }
+}
+
+void SimpleKV::publish(change_type type,
+                       const string& nspace,
+                       const string& key,
+                       const string& value) {
+  for (const auto& sub : subscribers) {
+    if (sub->matches(nspace, key)) {
+      sub->publish(ChangeEvent{type, nspace, key, value});
+    }
+  }
+}
+
+void SimpleKV::pushed(change_type type,
+                      const string& nspace,
+                      const string& key,
+                      const string& value) {
+  if (auto* index = index_for(nspace)) {
+    index->add_element(key, value);
+  }
+  tier_written(nspace, value.size());
+  maybe_compress_list(nspace, key, value.size());
+  publish(type, nspace, key, value);
+  // wake anyone parked in blpop/brpop on this list
+  if (!waiters.empty()) {
+    auto iter = waiters.find(waiter_key(nspace, key));
+    if (iter != waiters.end()) {
+      iter->second.ready.notify_all();
+    }
+  }
+}
+
+void SimpleKV::popped(change_type type,
+                      const string& nspace,
+                      const string& key,
+                      const string& value) {
+  if (auto* index = index_for(nspace)) {
+    index->remove_element(key, value);
+  }
+  list_shrank(nspace, key, value.size());
+  publish(type, nspace, key, value);
+}
+
+ValueIndex* SimpleKV::index_for(const string& nspace) {
+  // the common case is no indexes at all, keep that to one branch
+  if (value_indexes.empty()) {
+    return nullptr;
+  }
+  auto iter = value_indexes.find(nspace);
+  if (iter == value_indexes.end()) {
+    return nullptr;
+  }
+  if (iter->second.use_count() > 1) {
+    iter->second = make_shared<ValueIndex>(*iter->second);
+  }
+  return iter->second.get();
+}
+
+void SimpleKV::index_value(const string& nspace,
+                           const string& key,
+                           const ValueType& value) {
+  auto* index = index_for(nspace);
+  if (index == nullptr) {
+    return;
+  }
+  if (auto str = string_of(nspace, value)) {
+    index->add_string(key, *str);
+    return;
+  }
+  for (const auto& elem : elements_of(nspace, value)) {
+    index->add_element(key, elem);
+  }
+}
+
+void SimpleKV::unindex_value(const string& nspace,
+                             const string& key,
+                             const ValueType& value) {
+  auto* index = index_for(nspace);
+  if (index == nullptr) {
+    return;
+  }
+  if (auto str = string_of(nspace, value)) {
+    index->remove_string(key, *str);
+    return;
+  }
+  for (const auto& elem : elements_of(nspace, value)) {
+    index->remove_element(key, elem);
+  }
+}
+
+void SimpleKV::reindex_element(const string& nspace,
+                               const string& key,
+                               const string& old_elem,
+                               const string& new_elem) {
+  auto* index = index_for(nspace);
+  index->remove_element(key, old_elem);
+  index->add_element(key, new_elem);
+}
+
+void SimpleKV::rebuild_index(const string& nspace) {
+  auto* index = index_for(nspace);
+  index->clear();
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return;
+  }
+  for (const auto& keypair : *first_iter->second) {
+    index_value(nspace, keypair.first, *keypair.second);
+  }
+}
+
+optional<string> SimpleKV::string_of(const string& nspace,
+                                     const ValueType& value) const {
+  if (holds_alternative<string>(value)) {
+    return get<string>(value);
+  }
+  if (holds_alternative<CompressedString>(value)) {
+    const auto& packed = get<CompressedString>(value);
+    return decompress_block(packed.data, packed.raw_size);
+  }
+  if (holds_alternative<InternedString>(value)) {
+    return get<InternedString>(value).str();
+  }
+  if (holds_alternative<SpilledValue>(value) &&
+      !get<SpilledValue>(value).is_list) {
+    auto loaded = read_spilled(nspace, get<SpilledValue>(value));
+    if (loaded) {
+      return get<string>(*loaded);
+    }
+  }
+  return nullopt;
+}
+
+vector<string> SimpleKV::elements_of(const string& nspace,
+                                     const ValueType& value) const {
+  if (holds_alternative<vector<string>>(value)) {
+    return get<vector<string>>(value);
+  }
+  if (holds_alternative<CompressedList>(value)) {
+    return get<CompressedList>(value).members();
+  }
+  vector<string> res;
+  if (holds_alternative<InternedList>(value)) {
+    for (const auto& elem : get<InternedList>(value)) {
+      res.push_back(elem.str());
+    }
+  }
+  if (holds_alternative<SpilledValue>(value) &&
+      get<SpilledValue>(value).is_list) {
+    auto loaded = read_spilled(nspace, get<SpilledValue>(value));
+    if (loaded) {
+      res = move(get<vector<string>>(*loaded));
+    }
+  }
+  return res;
+}
 }  // namespace simplekv
 // namespace simplekv
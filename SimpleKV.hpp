@@ -1,12 +1,31 @@
 #ifndef SIMPLEKV_HPP_
 #define SIMPLEKV_HPP_
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <typeinfo>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "./ChangeFeed.hpp"
+#include "./Compression.hpp"
+#include "./SpillLog.hpp"
+#include "./StringPool.hpp"
+#include "./TypedNamespace.hpp"
+#include "./ValueIndex.hpp"
+
 namespace simplekv {
 
 // Enum that declares three diferent values
@@ -15,17 +34,67 @@ namespace simplekv {
 // it exists
 enum class value_type_info { none, string, list };
 
+// Enum that declares the input formats SimpleKV::bulk_load() can read
+//
+// lines:  one record per line, four tab separated fields
+//           <op>\t<nspace>\t<key>\t<value>
+//         where op is S (sset) or R (rpush). Tabs, newlines and
+//         backslashes inside a field are written as \t, \n and \\.
+// binary: one record after another, each an op byte ('S' or 'R')
+//         followed by nspace, key and value, each a 4 byte little endian
+//         length and then that many bytes.
+enum class bulk_format { lines, binary };
+
+// Returned by SimpleKV::compression_stats() to describe how well the
+// values of a namespace are compressing
+struct CompressionStats {
+  // how many values are in the namespace
+  size_t values = 0;
+  // how many of those are stored compressed
+  size_t compressed_values = 0;
+  // the size of the compressed values before and after compression
+  size_t raw_bytes = 0;
+  size_t stored_bytes = 0;
+
+  // Returns how many times smaller the compressed values are
+  double ratio() const {
+    return stored_bytes == 0 ? 1.0
+                             : static_cast<double>(raw_bytes) / stored_bytes;
+  }
+};
+
+// Returned by SimpleKV::tier_stats() to describe how much of a tiered
+// namespace lives in memory and how much on disk
+struct TierStats {
+  // the size of the values big enough to spill that are still in memory
+  size_t resident_bytes = 0;
+  // how many values are on disk and how big they are
+  size_t spilled_values = 0;
+  size_t spilled_bytes = 0;
+  // the size of the log file, including space compaction hasn't taken
+  // back yet
+  size_t log_bytes = 0;
+  // how many times a value was written out / read back in
+  size_t spills = 0;
+  size_t faults = 0;
+};
+
+class KeyHandle;
+class QueryEngine;
+class ValueRef;
+
+// All operations are safe to call from several threads at once.
 class SimpleKV {
  public:
   // Constructs an empty SimpleKV Object
-  SimpleKV() = default;
+  SimpleKV();
 
-  // ignore these, we will cover these later
+  // ignore these, we will cover these later. See clone() for copies.
   SimpleKV(const SimpleKV& other) = delete;
   SimpleKV(SimpleKV&& other) = delete;
   SimpleKV& operator=(const SimpleKV& other) = delete;
   SimpleKV& operator=(SimpleKV&& other) = delete;
-  ~SimpleKV() = default;
+  ~SimpleKV();
 
   /////////////////////////////////////////////////////////////////////////////
   // General Operations
@@ -400,14 +469,746 @@ class SimpleKV {
                                                 const std::string& nspace2,
                                                 const std::string& key2);
 
+  /////////////////////////////////////////////////////////////////////////////
+  // Blocking Operations
+  /////////////////////////////////////////////////////////////////////////////
+
+  // "Blocking List Pop"
+  //
+  // Pops a value off the front of the specified list like lpop, but if
+  // the list does not exist yet the caller is parked until an lpush or
+  // rpush adds a value or the timeout runs out.
+  // Callers waiting on the same list are served in the order they arrived.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace we want to look in for the
+  //           specified key.
+  // - key: the name of the key whose value we want to pop from
+  // - timeout: the longest time to wait for a value
+  //
+  // Returns:
+  // - nullopt if it is a string or no value arrived in time
+  // - the value popped of the list
+  std::optional<std::string> blpop(const std::string& nspace,
+                                   const std::string& key,
+                                   std::chrono::milliseconds timeout);
+
+  // "Blocking List Right Pop"
+  //
+  // Same as blpop, but pops the value off the back of the list like rpop.
+  std::optional<std::string> brpop(const std::string& nspace,
+                                   const std::string& key,
+                                   std::chrono::milliseconds timeout);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Change Feed
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Subscribes to the changes made to keys in the specified namespace.
+  // Every successful sset, del, lset, push and pop on a matching key is
+  // queued on the returned subscription until the subscriber takes it.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace to watch
+  // - key_prefix: only keys that start with this prefix are reported,
+  //               the empty string matches every key
+  // - capacity: how many events may be queued before new ones are dropped
+  //
+  // Returns:
+  // - the subscription to read events from
+  std::shared_ptr<Subscription> subscribe(const std::string& nspace,
+                                          const std::string& key_prefix = "",
+                                          size_t capacity = 1024);
+
+  // Stops delivering events to the specified subscription
+  //
+  // Returns:
+  // - true iff the subscription was active
+  bool unsubscribe(const std::shared_ptr<Subscription>& sub);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Compression
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Turns on compression of the values in the specified namespace.
+  // From now on strings of at least threshold bytes are stored compressed,
+  // and lists whose elements add up to at least threshold bytes are
+  // converted to chunks of compressed elements, so that lindex, lset and
+  // the pushes and pops only have to expand a single chunk. Lists are
+  // checked on every push, including the one that creates them.
+  // Strings that are already stored are left as they are, and lists that
+  // are already stored are converted by the next push once they are past
+  // the threshold.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace to compress
+  // - threshold: the smallest value, in bytes, that is worth compressing
+  //
+  // Returns: None
+  void enable_compression(const std::string& nspace, size_t threshold = 4096);
+
+  // Turns off compression for new values in the specified namespace.
+  // Values that are already compressed stay compressed.
+  void disable_compression(const std::string& nspace);
+
+  // Gets statistics on how well the values of the specified namespace
+  // are compressing
+  //
+  // Returns:
+  // - the statistics, all zeros if the namespace doesn't exist
+  CompressionStats compression_stats(const std::string& nspace);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Tiered Storage
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Turns on tiered storage for the specified namespace. Keys and small
+  // values always stay in memory. Once the values of at least
+  // min_value_bytes add up to more than memory_budget, the least recently
+  // used ones are moved out to a log file, and using one of them again
+  // reads it back in. Space in the log is taken back in the
+  // background. If a spilled value can't be read back, operations on its
+  // key fail as if it held the wrong type.
+  //
+  // Calling this again on a tiered namespace with the same path only
+  // changes the limits. Each log file belongs to one namespace; clones
+  // share their original's logs.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace to tier
+  // - path: the log file to spill to, it is created or truncated and is
+  //         removed again when tiering is turned off
+  // - memory_budget: how many bytes of large values to keep in memory
+  // - min_value_bytes: the smallest value, in bytes, that is worth spilling
+  //
+  // Returns:
+  // - false if the log file couldn't be created, if another namespace or
+  //   object in this process is already spilling to path, or if the
+  //   namespace is already tiered to a different path. Nothing changes
+  //   then.
+  bool enable_tiering(const std::string& nspace,
+                      const std::string& path,
+                      size_t memory_budget,
+                      size_t min_value_bytes = 4096);
+
+  // Turns off tiered storage for the specified namespace, reading every
+  // spilled value back into memory
+  //
+  // Returns:
+  // - false if some value couldn't be read back, tiering stays on then
+  bool disable_tiering(const std::string& nspace);
+
+  // Gets statistics on how much of the specified namespace is in memory
+  //
+  // Returns:
+  // - the statistics, all zeros if the namespace isn't tiered
+  TierStats tier_stats(const std::string& nspace);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Interning
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Turns on interning for new values in the specified namespace.
+  // Strings set with sset and list elements pushed or set from now on are
+  // stored once in a pool shared by the whole object and referenced by
+  // handle, so repeated values (status codes, tenant ids...) only take up
+  // memory once. lunion, linter and ldiff compare two interned lists by
+  // handle instead of hashing every element.
+  // Values that are already stored are left as they are. Strings large
+  // enough to be compressed are compressed rather than interned.
+  //
+  // Keys and namespace names are not interned here. A key is stored once
+  // per namespace and a pool entry costs about three times what the string
+  // does (the string, a count and a map node), so interning unique keys
+  // would grow memory, and short keys fit in the string itself anyway.
+  // Where a key does repeat, in a value index that records a list's key
+  // for every distinct element of the list, the index interns it. A
+  // namespace name is kept once per setting turned on, which stays small
+  // next to its keys.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace to intern
+  //
+  // Returns: None
+  void enable_interning(const std::string& nspace);
+
+  // Turns off interning for new values in the specified namespace.
+  // Values that are already interned stay interned.
+  void disable_interning(const std::string& nspace);
+
+  // Returns the number of unique strings in the interning pool
+  size_t interned_strings();
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Typed Namespaces
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Gets the typed namespace with the specified name, creating it if it
+  // doesn't exist. A typed namespace stores values of type T in their
+  // binary layout, so reading and writing them never converts to or from
+  // a string, and numbers can be incremented in place.
+  //
+  // For example:
+  //   kv.typed<int64_t>("counters")->incr("page_views");
+  //
+  // Typed namespaces are kept apart from the string namespaces: they don't
+  // show up in namespaces() and the same name can be used for both.
+  //
+  // Arguments:
+  // - nspace: the name of the typed namespace
+  //
+  // Returns:
+  // - nullptr if a typed namespace with this name already exists with a
+  //   different value type
+  // - the typed namespace otherwise, which lives as long as this object
+  template <typename T>
+  TypedNamespace<T>* typed(const std::string& nspace);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Bulk Loading
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Loads a stream of sset/rpush records, building the data on several
+  // threads and then publishing it all into this object at once.
+  //
+  // The first records are sampled to estimate how big the hash tables
+  // will get so that they are sized up front. Records are then spread
+  // over the worker threads by a hash of their namespace and key, so each
+  // key is built by one worker in input order, and each worker fills its
+  // own private shard. Once the input is read the shards are moved into
+  // the store under the lock; other threads see either none or all of the
+  // loaded data.
+  //
+  // The records land on top of what this object already holds, the same
+  // way the sset and rpush calls would: an S record replaces the key's
+  // value, an R record pushes onto the list already at the key and is
+  // skipped if the key holds a string. Loading two files one after the
+  // other gives the same lists as loading them as one.
+  // Bulk loads are not reported to change feed subscribers, and value
+  // indexes are rebuilt from scratch afterwards.
+  //
+  // Arguments:
+  // - in: the stream to read the records from
+  // - format: how the records are encoded, see bulk_format
+  // - threads: how many worker threads to build with, 0 means one per core
+  //
+  // Returns:
+  // - nullopt if the input is malformed, in which case nothing is loaded.
+  //   That includes a binary record whose length runs past the end of the
+  //   input; the length is never trusted beyond the bytes that arrive.
+  // - the number of records loaded otherwise
+  std::optional<size_t> bulk_load(std::istream& in,
+                                  bulk_format format,
+                                  size_t threads = 0);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Cloning
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Makes a copy of this object that can be changed independently of it.
+  //
+  // The copy shares each namespace with this object until one of the two
+  // writes to it, so cloning costs one pointer per namespace and
+  // namespaces that are only read are never copied. Values are shared one
+  // by one: the first write to a shared namespace copies its table of
+  // keys, one pointer per key, and then only the value being changed.
+  // Values that are never changed are never copied, so a clone that
+  // changes a few large values costs little more than those values.
+  // Writes that turn out to change nothing (deleting a missing key,
+  // popping an empty list, an lset out of bounds) don't copy. Value
+  // indexes are shared per namespace, and values spilled by tiered storage
+  // stay in the same log file. Typed namespaces are copied right away.
+  //
+  // The settings of every namespace (compression, interning, indexes and
+  // tiering) carry over. Change feed subscriptions and callers parked in
+  // blpop/brpop don't.
+  //
+  // The copy shares its lock and its string pool with this object, so
+  // operations on the two still take turns with each other, for as long as
+  // both exist. This is a known limitation: interned strings count their
+  // references without atomics and shared values are copied on write
+  // under that lock, so the two can't run side by side.
+  //
+  // Returns:
+  // - the copy
+  std::unique_ptr<SimpleKV> clone();
+
+  // Makes a copy of a single namespace, the same way as clone()
+  //
+  // Arguments:
+  // - nspace: the name of the namespace to copy
+  //
+  // Returns:
+  // - a new object holding only that namespace, empty if it doesn't exist
+  std::unique_ptr<SimpleKV> clone_namespace(const std::string& nspace);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Value Indexes
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Turns on a reverse index for the specified namespace, built from the
+  // values already there and then kept up to date by every sset, del,
+  // lset, push and pop. It makes find_by_value and find_lists_containing
+  // a lookup instead of a scan, at the cost of extra work on every write.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace to index
+  //
+  // Returns: None
+  void enable_value_index(const std::string& nspace);
+
+  // Turns off and throws away the reverse index of the specified namespace
+  void disable_value_index(const std::string& nspace);
+
+  // Gets the keys in the specified namespace whose string value is exactly
+  // the specified value. Scans the namespace if it isn't indexed.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace we want to look in
+  // - value: the string value to look for
+  //
+  // Returns:
+  // - a vector of the matching keys, in any order
+  std::vector<std::string> find_by_value(const std::string& nspace,
+                                         const std::string& value);
+
+  // Gets the keys in the specified namespace whose list contains the
+  // specified element at least once. Scans the namespace if it isn't
+  // indexed.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace we want to look in
+  // - elem: the list element to look for
+  //
+  // Returns:
+  // - a vector of the matching keys, in any order
+  std::vector<std::string> find_lists_containing(const std::string& nspace,
+                                                 const std::string& elem);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Key Handles
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Gets a handle to the specified key, for code that uses the same keys
+  // over and over. The handle remembers where the key's value is stored,
+  // so the operations below that take a handle can skip looking up the
+  // namespace and the key. The key doesn't have to exist yet.
+  //
+  // A handle checks that what it remembers is still current every time it
+  // is used, and looks the key up again if it isn't: after any key or
+  // namespace is deleted, after the object is cloned or its namespace is
+  // copied, and after a namespace setting changes. Handles to keys in
+  // namespaces that compress, intern, index or tier their values always
+  // take the regular path.
+  //
+  // A handle can be copied freely, but one handle must not be used from
+  // several threads at once. A handle used with an object other than the
+  // one that made it still works, just without the shortcut.
+  //
+  // Arguments:
+  // - nspace: the name of the namespace the key is in
+  // - key: the name of the key
+  //
+  // Returns:
+  // - the handle
+  KeyHandle handle(const std::string& nspace, const std::string& key);
+
+  // The operations above, on the key of a handle
+  bool key_exists(const KeyHandle& handle);
+  value_type_info type(const KeyHandle& handle);
+  bool del(const KeyHandle& handle);
+  std::optional<std::string> sget(const KeyHandle& handle);
+  void sset(const KeyHandle& handle, const std::string& value);
+  ssize_t llen(const KeyHandle& handle);
+  std::optional<std::string> lindex(const KeyHandle& handle, size_t index);
+  std::optional<std::vector<std::string>> lmembers(const KeyHandle& handle);
+  bool lset(const KeyHandle& handle, size_t index, const std::string& value);
+  bool lpush(const KeyHandle& handle, const std::string& value);
+  std::optional<std::string> lpop(const KeyHandle& handle);
+  bool rpush(const KeyHandle& handle, const std::string& value);
+  std::optional<std::string> rpop(const KeyHandle& handle);
+
  private:
+  // queries read the stored values in place
+  friend class QueryEngine;
+  friend class ValueRef;
+  // handles remember where a value is stored
+  friend class KeyHandle;
+
+  // Constructs an empty object that shares its lock and string pool with
+  // the object it is cloned from
+  SimpleKV(std::shared_ptr<std::recursive_mutex> shared_mtx,
+           std::shared_ptr<StringPool> shared_pool);
+
+  // Shared implementation of clone and clone_namespace
+  std::unique_ptr<SimpleKV> clone_of(const std::optional<std::string>& only);
+
+  // Guards everything in the object. It is recursive because operations
+  // like lunion are built out of other public operations. Clones share it,
+  // since they share namespaces and interned strings.
+  std::shared_ptr<std::recursive_mutex> shared_mtx;
+  std::recursive_mutex& mtx;
+
+  // The pool is declared before kv_store so that it is destroyed after
+  // the interned values that point into it
+  std::shared_ptr<StringPool> shared_pool;
+  StringPool& pool;
+
   // Declare an undordered map in the private section of the class
   // This is where we will store all of our data
-  using ValueType = std::variant<std::string, std::vector<std::string>>;
-  std::unordered_map<std::string, std::unordered_map<std::string, ValueType>>
-      kv_store;
+  using InternedList = std::vector<InternedString>;
+  using ValueType = std::variant<std::string,
+                                 std::vector<std::string>,
+                                 CompressedString,
+                                 CompressedList,
+                                 InternedString,
+                                 InternedList,
+                                 SpilledValue>;
+
+  // A stored value. Copying one only copies a pointer, so the copy of a
+  // namespace shares every value with the original until one side changes
+  // it. Reading goes through *, changing through mut(), which copies the
+  // value first if another namespace still holds it.
+  class SharedValue {
+   public:
+    SharedValue() = default;
+    SharedValue(ValueType value)
+        : ptr(std::make_shared<ValueType>(std::move(value))) {}
+
+    // Replaces the value, in place unless another namespace holds it
+    SharedValue& operator=(ValueType value) {
+      if (ptr != nullptr && ptr.use_count() == 1) {
+        *ptr = std::move(value);
+      } else {
+        ptr = std::make_shared<ValueType>(std::move(value));
+      }
+      return *this;
+    }
+
+    const ValueType& operator*() const { return *ptr; }
+
+    ValueType& mut() {
+      if (ptr.use_count() > 1) {
+        ptr = std::make_shared<ValueType>(*ptr);
+      }
+      return *ptr;
+    }
+
+    // Returns true iff another namespace holds this value too
+    bool shared() const { return ptr.use_count() > 1; }
+
+   private:
+    std::shared_ptr<ValueType> ptr;
+  };
+
+  using KeyMap = std::unordered_map<std::string, SharedValue>;
+  // namespace -> its keys. The keys of a namespace may be shared with
+  // clones, anything that changes them goes through writable() first, and
+  // the values in them may be shared too, see SharedValue.
+  std::unordered_map<std::string, std::shared_ptr<KeyMap>> kv_store;
+
+  // Bumped whenever a value a KeyHandle remembers may have moved or its
+  // namespace's settings changed: a key or namespace is erased, a
+  // namespace's keys are copied or replaced, the object is cloned, or a
+  // namespace setting is turned on or off
+  uint64_t generation = 0;
+
+  // Unique to this object for the life of the process, unlike its address,
+  // which an object created after this one is destroyed may reuse. A
+  // KeyHandle from another object, or from one that was destroyed, never
+  // matches it.
+  const uint64_t id;
+
+  // The callers parked in blpop/brpop on one list, in arrival order
+  struct Waiters {
+    std::deque<uint64_t> line;
+    std::condition_variable_any ready;
+  };
+  // waiter_key(nspace, key) -> callers waiting on that list
+  std::unordered_map<std::string, Waiters> waiters;
+  uint64_t next_ticket = 0;
+
+  std::vector<std::shared_ptr<Subscription>> subscribers;
+
+  // namespace -> smallest value worth compressing, for the namespaces with
+  // compression turned on
+  std::unordered_map<std::string, size_t> compression;
+  // compressed namespace -> key -> what the elements of the list at the key
+  // add up to, in bytes, for the lists that aren't compressed yet
+  std::unordered_map<std::string, std::unordered_map<std::string, size_t>>
+      list_bytes;
+
+  // the namespaces with interning turned on
+  std::unordered_set<std::string> interning;
+
+  // namespace -> reverse index, for the namespaces that have one. Shared
+  // with clones until one of them changes it, like kv_store.
+  std::unordered_map<std::string, std::shared_ptr<ValueIndex>> value_indexes;
+
+  // namespace -> typed namespace, see typed()
+  std::unordered_map<std::string, std::unique_ptr<TypedNamespaceBase>>
+      typed_namespaces;
+
+  // The spill state of a tiered namespace
+  struct Tier {
+    // clones spill to the same log
+    std::shared_ptr<SpillLog> log;
+    size_t memory_budget;
+    size_t min_value_bytes;
+    // bytes written or read back in since the last sweep
+    size_t since_sweep = 0;
+
+    // A key that holds a large value in memory, or was used since the last
+    // sweep and may now hold one
+    struct Resident {
+      std::string key;
+      // what the value added up to when it was last counted
+      size_t bytes = 0;
+      bool counted = false;
+    };
+    // least recently used first, so a sweep spills from the front and only
+    // looks at what it spills. The keys used since the last sweep are at
+    // the back and are counted by the next one.
+    std::list<Resident> recency;
+    // key -> its entry in recency, viewing the entry's own key
+    std::unordered_map<std::string_view, std::list<Resident>::iterator>
+        positions;
+    // what the counted entries add up to
+    size_t resident_bytes = 0;
+    // values may have changed without being used (a new tier, a clone, a
+    // bulk load), so the next sweep counts the whole namespace once
+    bool recount = true;
+
+    size_t spills = 0;
+    size_t faults = 0;
+
+    Tier() = default;
+    // positions points into recency, so a tier can be moved but not copied
+    Tier(Tier&& other) = default;
+    Tier(const Tier& other) = delete;
+
+    // Moves the key to the back of recency, to be counted again
+    void touch(const std::string& key);
+
+    // Drops an entry from recency
+    //
+    // Returns:
+    // - the entry after it
+    std::list<Resident>::iterator forget(std::list<Resident>::iterator iter);
+  };
+  // namespace -> spill state, for the namespaces with tiering turned on
+  std::unordered_map<std::string, Tier> tiers;
+
+  // Gets the keys of a namespace for changing them, copying them first if
+  // they are shared with a clone. The copy shares the values, changing one
+  // goes through SharedValue::mut() or assignment. Only call it once the
+  // change is certain, the copy costs a pointer per key even if nothing
+  // changes.
+  KeyMap& writable(std::shared_ptr<KeyMap>& keys);
+
+  // The same, for a caller that already found its key in the shared keys.
+  // key_iter is moved over to the copy if there is one.
+  KeyMap& writable(std::shared_ptr<KeyMap>& keys, KeyMap::iterator* key_iter);
+
+  // Returns whether the value is a list held in memory, the only kind of
+  // value a push or pop can change
+  static bool holds_list(const ValueType& value);
+
+  // Builds the stored form of a string, compressing or interning it if its
+  // namespace asks for it
+  ValueType make_string_value(const std::string& nspace,
+                              const std::string& value);
+
+  // Re-encodes a value built by bulk_load in its plain form the way its
+  // namespace stores values, compressing or interning it if asked to
+  ValueType encode_loaded(const std::string& nspace, ValueType&& value);
+
+  // Pushes the elements of a list built by bulk_load onto the list already
+  // stored at the key, or does nothing if the key holds a string
+  void append_loaded(const std::string& nspace,
+                     const std::string& key,
+                     std::vector<std::string>&& elems);
+
+  // Builds a new single element list, interned if its namespace asks for it
+  ValueType make_list_value(const std::string& nspace,
+                            const std::string& value);
+
+  // Gets the list stored at the key if it is an interned list
+  //
+  // Returns:
+  // - nullptr if the key doesn't exist or isn't an interned list
+  const InternedList* find_interned_list(const std::string& nspace,
+                                         const std::string& key);
+
+  // Counts the bytes just pushed onto the list at the key, and converts the
+  // list to a compressed one once it has grown past its namespace's
+  // threshold. Called after every push, including the one that creates the
+  // list.
+  void maybe_compress_list(const std::string& nspace,
+                           const std::string& key,
+                           size_t pushed_bytes);
+
+  // Takes the bytes just popped off the list at the key off its count
+  void list_shrank(const std::string& nspace,
+                   const std::string& key,
+                   size_t popped_bytes);
+
+  // Drops the count of the list at the key, after it was deleted, replaced
+  // or changed in place. It is added up again on the next push.
+  void forget_list_bytes(const std::string& nspace, const std::string& key);
+
+  // Shared implementation of blpop and brpop
+  std::optional<std::string> blocking_pop(const std::string& nspace,
+                                          const std::string& key,
+                                          std::chrono::milliseconds timeout,
+                                          bool front);
+
+  // Builds the key of the waiters map for a list
+  static std::string waiter_key(const std::string& nspace,
+                                const std::string& key);
+
+  // Queues a change on every subscription that is watching the key
+  void publish(change_type type,
+               const std::string& nspace,
+               const std::string& key,
+               const std::string& value);
+
+  // Indexes and publishes a push, and wakes the callers waiting on the list
+  void pushed(change_type type,
+              const std::string& nspace,
+              const std::string& key,
+              const std::string& value);
+
+  // Unindexes and publishes a pop
+  void popped(change_type type,
+              const std::string& nspace,
+              const std::string& key,
+              const std::string& value);
+
+  // Gets the reverse index of a namespace for changing it, copying it
+  // first if it is shared with a clone
+  //
+  // Returns:
+  // - nullptr if the namespace has no index
+  ValueIndex* index_for(const std::string& nspace);
+
+  // Adds / removes everything a stored value contributes to its
+  // namespace's index, if it has one
+  void index_value(const std::string& nspace,
+                   const std::string& key,
+                   const ValueType& value);
+  void unindex_value(const std::string& nspace,
+                     const std::string& key,
+                     const ValueType& value);
+
+  // Swaps one list element for another in an indexed namespace
+  void reindex_element(const std::string& nspace,
+                       const std::string& key,
+                       const std::string& old_elem,
+                       const std::string& new_elem);
+
+  // Rebuilds an indexed namespace's index from its stored values
+  void rebuild_index(const std::string& nspace);
+
+  // Gets a copy of a stored string value in any of its representations,
+  // reading it from the spill log if it was spilled
+  //
+  // Returns:
+  // - nullopt if the value is a list
+  std::optional<std::string> string_of(const std::string& nspace,
+                                       const ValueType& value) const;
+
+  // Gets a copy of the elements of a stored list in any of its
+  // representations, or an empty vector if the value is a string
+  std::vector<std::string> elements_of(const std::string& nspace,
+                                       const ValueType& value) const;
+
+  // Called at the start of an operation on a key of a tiered namespace.
+  // Spills cold values if a sweep is due, marks the key as used, and
+  // reads its value back in if load is set and it was spilled.
+  void tier_access(const std::string& nspace,
+                   const std::string& key,
+                   bool load);
+
+  // Counts bytes written to a tiered namespace towards the next sweep
+  void tier_written(const std::string& nspace, size_t bytes);
+
+  // Frees the log record of a value that is about to be overwritten or
+  // erased, if it was spilled and no clone holds the value too. Each stored
+  // value holds one reference to its record, however many namespaces share
+  // the value.
+  void discard_spilled(const std::string& nspace, const SharedValue& value);
+
+  // Spills the large values of a tiered namespace, least recently used
+  // first, until the rest fit in its budget. Costs O(values used since the
+  // last sweep + values spilled), except for the first sweep after a
+  // recount which walks the namespace.
+  void sweep(const std::string& nspace, Tier& tier);
+
+  // Reads a spilled value back in its plain form. Safe to call from
+  // several threads at once while the caller holds the lock.
+  //
+  // Returns:
+  // - nullopt if the namespace isn't tiered or the record can't be read
+  std::optional<ValueType> read_spilled(const std::string& nspace,
+                                        const SpilledValue& stub) const;
+
+  // Gets roughly how many bytes of memory a stored value takes
+  static size_t value_bytes(const ValueType& value);
+
+  // Gets the value a handle points to, looking it up again if the handle
+  // is out of date
+  //
+  // Returns:
+  // - nullptr if the key doesn't exist or the operation has to take the
+  //   regular path
+  // - the stored value otherwise. It can still be encoded if it was stored
+  //   before a namespace setting was turned off, so the caller has to check
+  //   that it is a plain string or list.
+  ValueType* resolve(const KeyHandle& handle);
+};
+
+// A (namespace, key) pair that remembers where its value is stored in a
+// SimpleKV object, see SimpleKV::handle()
+class KeyHandle {
+ public:
+  // Returns the names of the namespace and the key
+  const std::string& nspace() const { return ns; }
+  const std::string& key() const { return k; }
+
+ private:
+  friend class SimpleKV;
+
+  KeyHandle(uint64_t owner, std::string nspace, std::string key)
+      : owner(owner), ns(std::move(nspace)), k(std::move(key)) {}
+
+  // the id of the object that made the handle, see SimpleKV::id
+  uint64_t owner;
+  std::string ns;
+  std::string k;
+
+  // what resolve() found the last time, good for as long as the owner's
+  // generation hasn't changed. slot is nullptr if the key didn't exist.
+  mutable uint64_t generation = 0;
+  mutable SimpleKV::SharedValue* slot = nullptr;
+  // whether the namespace stores new values as is and neither it nor the
+  // value is shared with a clone, so that operations can work on slot
+  // directly
+  mutable bool direct = false;
 };
 
+template <typename T>
+TypedNamespace<T>* SimpleKV::typed(const std::string& nspace) {
+  std::lock_guard<std::recursive_mutex> lock(mtx);
+  auto& slot = typed_namespaces[nspace];
+  if (!slot) {
+    slot = std::make_unique<TypedNamespace<T>>();
+  } else if (slot->value_type() != typeid(T)) {
+    return nullptr;
+  }
+  return static_cast<TypedNamespace<T>*>(slot.get());
+}
+
 }  // namespace simplekv
 
 #endif  // SIMPLEKV_HPP_
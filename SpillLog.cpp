@@ -0,0 +1,300 @@
+#include "./SpillLog.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+using namespace std;
+
+namespace simplekv {
+
+namespace {
+
+// don't bother compacting until there is at least this much garbage
+constexpr uint64_t kMinGarbageBytes = 1 << 16;
+
+// pread / pwrite until the whole buffer is done, they may stop short
+bool read_all(int fd, char* buf, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t got = pread(fd, buf, len, static_cast<off_t>(offset));
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    buf += got;
+    len -= static_cast<size_t>(got);
+    offset += static_cast<uint64_t>(got);
+  }
+  return true;
+}
+
+bool write_all(int fd, const char* buf, size_t len, uint64_t offset) {
+  while (len > 0) {
+    ssize_t put = pwrite(fd, buf, len, static_cast<off_t>(offset));
+    if (put < 0 && errno == EINTR) {
+      continue;
+    }
+    if (put <= 0) {
+      return false;
+    }
+    buf += put;
+    len -= static_cast<size_t>(put);
+    offset += static_cast<uint64_t>(put);
+  }
+  return true;
+}
+
+// The files of every log open in this process, so that a second log on
+// the same path can't truncate the records of the first
+struct OpenFiles {
+  mutex mtx;
+  unordered_set<string> paths;
+};
+
+OpenFiles& open_files() {
+  static OpenFiles files;
+  return files;
+}
+
+// Gets the path with its directory resolved, so that two spellings of the
+// same file (relative, through a symlinked directory, with . or ..) turn
+// into the same string. The file itself doesn't have to exist yet.
+string canonical_path(const string& path) {
+  size_t slash = path.find_last_of('/');
+  string dir = slash == string::npos ? "." : path.substr(0, slash + 1);
+  string name = slash == string::npos ? path : path.substr(slash + 1);
+  char resolved[PATH_MAX];
+  if (realpath(dir.c_str(), resolved) == nullptr) {
+    return path;
+  }
+  string res = resolved;
+  if (res.back() != '/') {
+    res += '/';
+  }
+  return res + name;
+}
+
+// Claims a log file and the compaction file next to it
+//
+// Returns:
+// - false if another log already has either of them
+bool claim(const string& canonical) {
+  auto& files = open_files();
+  lock_guard<mutex> lock(files.mtx);
+  string compact = canonical + ".compact";
+  if (files.paths.count(canonical) != 0 || files.paths.count(compact) != 0) {
+    return false;
+  }
+  files.paths.insert(canonical);
+  files.paths.insert(compact);
+  return true;
+}
+
+void unclaim(const string& canonical) {
+  auto& files = open_files();
+  lock_guard<mutex> lock(files.mtx);
+  files.paths.erase(canonical);
+  files.paths.erase(canonical + ".compact");
+}
+
+}  // namespace
+
+SpillLog::SpillLog(string path)
+    : path(move(path)), canonical(canonical_path(this->path)) {
+  // only truncate the file once we know no other log is using it
+  if (claim(canonical)) {
+    fd = open(this->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+              0600);
+    if (fd == -1) {
+      unclaim(canonical);
+    }
+  }
+  compactor = thread([this] { compact_loop(); });
+}
+
+SpillLog::~SpillLog() {
+  {
+    lock_guard<mutex> lock(compact_mtx);
+    stopping = true;
+  }
+  compact_ready.notify_one();
+  compactor.join();
+  if (fd != -1) {
+    close(fd);
+    unlink(path.c_str());
+    unclaim(canonical);
+  }
+}
+
+bool SpillLog::same_file(const string& other) const {
+  return canonical_path(other) == canonical;
+}
+
+optional<uint64_t> SpillLog::append(const string& data) {
+  unique_lock<shared_mutex> lock(mtx);
+  if (fd == -1 || data.size() > UINT32_MAX) {
+    return nullopt;
+  }
+  if (!write_all(fd, data.data(), data.size(), end)) {
+    return nullopt;
+  }
+  uint64_t id = next_id++;
+  records[id] = Location{end, static_cast<uint32_t>(data.size()), 1};
+  end += data.size();
+  live += data.size();
+  return id;
+}
+
+optional<string> SpillLog::read(uint64_t id) const {
+  shared_lock<shared_mutex> lock(mtx);
+  auto iter = records.find(id);
+  if (iter == records.end()) {
+    return nullopt;
+  }
+  string data(iter->second.length, '\0');
+  if (!read_all(fd, &data[0], data.size(), iter->second.offset)) {
+    return nullopt;
+  }
+  return data;
+}
+
+void SpillLog::retain(uint64_t id) {
+  unique_lock<shared_mutex> lock(mtx);
+  auto iter = records.find(id);
+  if (iter != records.end()) {
+    iter->second.refs++;
+  }
+}
+
+void SpillLog::release(uint64_t id) {
+  bool wake = false;
+  {
+    unique_lock<shared_mutex> lock(mtx);
+    auto iter = records.find(id);
+    if (iter == records.end() || --iter->second.refs > 0) {
+      return;
+    }
+    live -= iter->second.length;
+    records.erase(iter);
+    wake = wants_compaction();
+  }
+  if (wake) {
+    lock_guard<mutex> lock(compact_mtx);
+    compact_wanted = true;
+    compact_ready.notify_one();
+  }
+}
+
+size_t SpillLog::live_bytes() const {
+  shared_lock<shared_mutex> lock(mtx);
+  return live;
+}
+
+size_t SpillLog::file_bytes() const {
+  shared_lock<shared_mutex> lock(mtx);
+  return end;
+}
+
+bool SpillLog::wants_compaction() const {
+  uint64_t garbage = end - live;
+  return garbage >= kMinGarbageBytes && garbage > live;
+}
+
+void SpillLog::compact_loop() {
+  unique_lock<mutex> lock(compact_mtx);
+  while (true) {
+    compact_ready.wait(lock, [this] { return compact_wanted || stopping; });
+    if (stopping) {
+      return;
+    }
+    compact_wanted = false;
+    lock.unlock();
+    compact();
+    lock.lock();
+  }
+}
+
+bool SpillLog::compact() {
+  // take a snapshot of the live records, then copy them without holding
+  // the lock. Records never change once written, and only we ever close
+  // the file, so the old one stays readable the whole time.
+  unordered_map<uint64_t, Location> snapshot;
+  int old_fd;
+  {
+    shared_lock<shared_mutex> lock(mtx);
+    if (fd == -1 || !wants_compaction()) {
+      return true;
+    }
+    snapshot = records;
+    old_fd = fd;
+  }
+  string tmp_path = path + ".compact";
+  int new_fd =
+      open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (new_fd == -1) {
+    return false;
+  }
+  uint64_t new_end = 0;
+  string buf;
+  auto copy = [&](const Location& from, Location* to) {
+    buf.resize(from.length);
+    if (!read_all(old_fd, &buf[0], buf.size(), from.offset) ||
+        !write_all(new_fd, buf.data(), buf.size(), new_end)) {
+      return false;
+    }
+    *to = Location{new_end, from.length, from.refs};
+    new_end += from.length;
+    return true;
+  };
+  auto give_up = [&] {
+    close(new_fd);
+    unlink(tmp_path.c_str());
+    return false;
+  };
+  unordered_map<uint64_t, Location> moved;
+  for (const auto& pair : snapshot) {
+    if (!copy(pair.second, &moved[pair.first])) {
+      return give_up();
+    }
+  }
+
+  // now catch up with what happened while we were copying: records
+  // released since the snapshot are left behind, records appended since
+  // are copied over too
+  unique_lock<shared_mutex> lock(mtx);
+  unordered_map<uint64_t, Location> next;
+  next.reserve(records.size());
+  for (const auto& pair : records) {
+    auto iter = moved.find(pair.first);
+    if (iter != moved.end()) {
+      // the reference count may have changed since the snapshot
+      next.emplace(pair.first,
+                   Location{iter->second.offset, iter->second.length,
+                            pair.second.refs});
+    } else if (!copy(pair.second, &next[pair.first])) {
+      return give_up();
+    }
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    return give_up();
+  }
+  close(fd);
+  fd = new_fd;
+  end = new_end;
+  records = move(next);
+  return true;
+}
+
+}  // namespace simplekv
@@ -0,0 +1,131 @@
+#ifndef SPILLLOG_HPP_
+#define SPILLLOG_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace simplekv {
+
+// A value that has been moved out of memory into a namespace's spill log.
+// Only the record id stays behind, plus enough to answer type() without
+// reading the record back.
+struct SpilledValue {
+  uint64_t id;
+  bool is_list;
+};
+
+// An append-only file of records that don't fit in memory.
+//
+// Records are named by an id handed out by append(). A record can be
+// shared by several owners, each taking a reference with retain() and
+// dropping it with release(). Once the last reference is dropped the
+// record is forgotten, and its space is taken back by compaction, which
+// copies the live records into a fresh file. Compaction runs on a
+// background thread once released records take up more of the file than
+// live ones, and records keep their ids, so the owners never see it
+// happen.
+//
+// read() may be called from several threads at once, and alongside any
+// other call.
+class SpillLog {
+ public:
+  // Creates (or truncates) the log file at the specified path and starts
+  // the compaction thread. A path that another log in this process is
+  // still using is refused and left alone, ok() is false then.
+  //
+  // Arguments:
+  // - path: where to keep the log. Compaction also uses path + ".compact"
+  //         while it runs.
+  explicit SpillLog(std::string path);
+
+  SpillLog(const SpillLog& other) = delete;
+  SpillLog(SpillLog&& other) = delete;
+  SpillLog& operator=(const SpillLog& other) = delete;
+  SpillLog& operator=(SpillLog&& other) = delete;
+
+  // Stops the compaction thread and removes the log file
+  ~SpillLog();
+
+  // Returns whether the log file could be opened
+  bool ok() const { return fd != -1; }
+
+  // Returns whether the specified path names this log's file
+  bool same_file(const std::string& other) const;
+
+  // Writes a record to the end of the log
+  //
+  // Arguments:
+  // - data: the bytes of the record
+  //
+  // Returns:
+  // - nullopt if the write failed
+  // - the id of the new record otherwise
+  std::optional<uint64_t> append(const std::string& data);
+
+  // Reads a record back
+  //
+  // Returns:
+  // - nullopt if there is no such record or the read failed
+  // - the bytes of the record otherwise
+  std::optional<std::string> read(uint64_t id) const;
+
+  // Takes / drops a reference to a record. append() hands out the first
+  // one, and the record is forgotten once the last one is dropped.
+  void retain(uint64_t id);
+  void release(uint64_t id);
+
+  // Returns the total size of the live records / of the file
+  size_t live_bytes() const;
+  size_t file_bytes() const;
+
+ private:
+  struct Location {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t refs;
+  };
+
+  // Copies the live records into a fresh file and switches over to it
+  //
+  // Returns:
+  // - false if the new file couldn't be written, the old one stays
+  bool compact();
+
+  // The loop the compaction thread runs
+  void compact_loop();
+
+  // Whether enough of the file is garbage to be worth compacting. Called
+  // with mtx held.
+  bool wants_compaction() const;
+
+  std::string path;
+  // path with its directory resolved, the name the log is claimed under
+  std::string canonical;
+
+  // guards everything below. read() takes it shared so that readers don't
+  // wait on each other, only on writers and on compaction switching files.
+  mutable std::shared_mutex mtx;
+  int fd = -1;
+  uint64_t end = 0;
+  uint64_t next_id = 0;
+  size_t live = 0;
+  std::unordered_map<uint64_t, Location> records;
+
+  // wakes the compaction thread
+  std::mutex compact_mtx;
+  std::condition_variable compact_ready;
+  bool compact_wanted = false;
+  bool stopping = false;
+  std::thread compactor;
+};
+
+}  // namespace simplekv
+
+#endif  // SPILLLOG_HPP_
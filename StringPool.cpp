@@ -0,0 +1,88 @@
+#include "./StringPool.hpp"
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+namespace simplekv {
+
+// InternedString
+
+InternedString::InternedString(Entry* entry) : entry(entry) {
+  entry->refs++;
+}
+
+InternedString::InternedString(const InternedString& other)
+    : entry(other.entry) {
+  if (entry != nullptr) {
+    entry->refs++;
+  }
+}
+
+InternedString::InternedString(InternedString&& other) noexcept
+    : entry(other.entry) {
+  other.entry = nullptr;
+}
+
+InternedString& InternedString::operator=(const InternedString& other) {
+  // take the new reference first in case both handles share an entry
+  if (other.entry != nullptr) {
+    other.entry->refs++;
+  }
+  release();
+  entry = other.entry;
+  return *this;
+}
+
+InternedString& InternedString::operator=(InternedString&& other) noexcept {
+  if (this != &other) {
+    release();
+    entry = other.entry;
+    other.entry = nullptr;
+  }
+  return *this;
+}
+
+InternedString::~InternedString() {
+  release();
+}
+
+const string& InternedString::str() const {
+  static const string empty;
+  return entry == nullptr ? empty : entry->value;
+}
+
+void InternedString::release() {
+  if (entry != nullptr && --entry->refs == 0) {
+    entry->pool->erase(entry);
+  }
+  entry = nullptr;
+}
+
+// StringPool
+
+StringPool::~StringPool() {
+  // any handle still alive at this point is a bug in the owner, but don't
+  // leak the entries
+  for (auto& pair : entries) {
+    delete pair.second;
+  }
+}
+
+InternedString StringPool::intern(const string& value) {
+  auto iter = entries.find(string_view(value));
+  if (iter != entries.end()) {
+    return InternedString(iter->second);
+  }
+  auto* entry = new InternedString::Entry{value, 0, this};
+  entries.emplace(string_view(entry->value), entry);
+  return InternedString(entry);
+}
+
+void StringPool::erase(InternedString::Entry* entry) {
+  entries.erase(string_view(entry->value));
+  delete entry;
+}
+
+}  // namespace simplekv
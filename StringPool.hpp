@@ -0,0 +1,105 @@
+#ifndef STRINGPOOL_HPP_
+#define STRINGPOOL_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace simplekv {
+
+class StringPool;
+
+// A reference counted handle to an immutable string stored once in a
+// StringPool. Two handles from the same pool hold equal strings iff they
+// point at the same entry, so they can be compared and hashed by id()
+// without looking at the characters.
+//
+// Handles are not thread safe on their own, the owner of the pool has to
+// make sure only one thread touches its handles at a time.
+class InternedString {
+ public:
+  // Constructs a null handle
+  InternedString() = default;
+
+  InternedString(const InternedString& other);
+  InternedString(InternedString&& other) noexcept;
+  InternedString& operator=(const InternedString& other);
+  InternedString& operator=(InternedString&& other) noexcept;
+  ~InternedString();
+
+  // Returns the string this handle points to
+  const std::string& str() const;
+
+  // Returns a value that is equal for two handles iff they hold the same
+  // string (for handles from the same pool)
+  const void* id() const { return entry; }
+
+  bool operator==(const InternedString& other) const {
+    return entry == other.entry;
+  }
+  bool operator!=(const InternedString& other) const {
+    return entry != other.entry;
+  }
+
+ private:
+  friend class StringPool;
+
+  struct Entry {
+    std::string value;
+    size_t refs;
+    StringPool* pool;
+  };
+
+  explicit InternedString(Entry* entry);
+  void release();
+
+  Entry* entry = nullptr;
+};
+
+// A set of unique strings handed out as InternedString handles.
+// A string is freed once the last handle to it goes away, so the pool
+// must outlive every handle it gave out.
+class StringPool {
+ public:
+  StringPool() = default;
+
+  StringPool(const StringPool& other) = delete;
+  StringPool(StringPool&& other) = delete;
+  StringPool& operator=(const StringPool& other) = delete;
+  StringPool& operator=(StringPool&& other) = delete;
+  ~StringPool();
+
+  // Gets a handle to the pooled copy of the string, adding it to the pool
+  // if it isn't there yet
+  InternedString intern(const std::string& value);
+
+  // Returns the number of unique strings in the pool
+  size_t size() const { return entries.size(); }
+
+ private:
+  friend class InternedString;
+
+  // Called by the last handle to an entry
+  void erase(InternedString::Entry* entry);
+
+  // keyed by a view of the entry's own string, so the characters are only
+  // stored once
+  std::unordered_map<std::string_view, InternedString::Entry*> entries;
+};
+
+}  // namespace simplekv
+
+namespace std {
+
+template <>
+struct hash<simplekv::InternedString> {
+  size_t operator()(const simplekv::InternedString& str) const {
+    return hash<const void*>()(str.id());
+  }
+};
+
+}  // namespace std
+
+#endif  // STRINGPOOL_HPP_
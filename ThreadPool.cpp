@@ -0,0 +1,105 @@
+#include "./ThreadPool.hpp"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace simplekv {
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = max<size_t>(1, thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; i++) {
+    queues.push_back(make_unique<WorkQueue>());
+  }
+  for (size_t i = 0; i < threads; i++) {
+    workers.emplace_back([this, i] { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(state_mtx);
+    stopping = true;
+  }
+  work_ready.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(vector<function<void()>> tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  lock_guard<mutex> run_lock(run_mtx);
+  // the count has to be in place before the first task is queued. A worker
+  // still draining the queues after the last batch can pick a new task up
+  // straight away, and would otherwise take it off a count of 0. Queueing
+  // under the lock keeps that worker from counting it until we're done.
+  unique_lock<mutex> lock(state_mtx);
+  remaining = tasks.size();
+  batch++;
+  // deal the tasks out evenly, stealing sorts out any imbalance
+  for (size_t i = 0; i < tasks.size(); i++) {
+    auto& queue = *queues[i % queues.size()];
+    lock_guard<mutex> queue_lock(queue.mtx);
+    queue.tasks.push_back(move(tasks[i]));
+  }
+  work_ready.notify_all();
+  batch_done.wait(lock, [this] { return remaining == 0; });
+}
+
+void ThreadPool::work(size_t self) {
+  size_t seen = 0;
+  while (true) {
+    {
+      unique_lock<mutex> lock(state_mtx);
+      work_ready.wait(lock, [&] { return stopping || batch != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = batch;
+    }
+    function<void()> task;
+    while (next_task(self, &task)) {
+      task();
+      lock_guard<mutex> lock(state_mtx);
+      if (--remaining == 0) {
+        batch_done.notify_all();
+      }
+    }
+  }
+}
+
+bool ThreadPool::next_task(size_t self, function<void()>* task) {
+  // our own work first, from the front
+  {
+    auto& queue = *queues[self];
+    lock_guard<mutex> lock(queue.mtx);
+    if (!queue.tasks.empty()) {
+      *task = move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  // then steal from the back of everyone else's
+  for (size_t i = 1; i < queues.size(); i++) {
+    auto& queue = *queues[(self + i) % queues.size()];
+    lock_guard<mutex> lock(queue.mtx);
+    if (!queue.tasks.empty()) {
+      *task = move(queue.tasks.back());
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace simplekv
@@ -0,0 +1,79 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simplekv {
+
+// A fixed set of worker threads that run batches of tasks with work
+// stealing.
+//
+// Each worker has its own deque of tasks. A worker takes tasks from the
+// front of its own deque, and once that runs dry it steals from the back
+// of the other workers' deques, so uneven tasks still keep every thread
+// busy.
+class ThreadPool {
+ public:
+  // Starts the worker threads
+  //
+  // Arguments:
+  // - threads: how many workers to start, 0 means one per core
+  explicit ThreadPool(size_t threads = 0);
+
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool(ThreadPool&& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+  ThreadPool& operator=(ThreadPool&& other) = delete;
+
+  // Stops and joins the worker threads
+  ~ThreadPool();
+
+  // Runs every task on the workers and waits for all of them to finish.
+  // Only one batch runs at a time, concurrent callers take turns.
+  //
+  // Arguments:
+  // - tasks: the tasks to run, in no particular order
+  void run(std::vector<std::function<void()>> tasks);
+
+  // Returns the number of worker threads
+  size_t size() const { return queues.size(); }
+
+ private:
+  struct WorkQueue {
+    std::mutex mtx;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // The loop each worker thread runs
+  void work(size_t self);
+
+  // Takes a task from our own queue, or steals one from another queue
+  bool next_task(size_t self, std::function<void()>* task);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> workers;
+
+  // serializes run() callers
+  std::mutex run_mtx;
+
+  // wakes the workers when a batch arrives, and the caller once it is done
+  std::mutex state_mtx;
+  std::condition_variable work_ready;
+  std::condition_variable batch_done;
+  // bumped for every batch so that sleeping workers notice a new one
+  size_t batch = 0;
+  size_t remaining = 0;
+  bool stopping = false;
+};
+
+}  // namespace simplekv
+
+#endif  // THREADPOOL_HPP_
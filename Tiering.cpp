@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "./SimpleKV.hpp"
+
+using namespace std;
+
+namespace simplekv {
+
+namespace {
+
+// a sweep is due once a quarter of the budget has been written or read
+// back in since the last one, so sweeps cost about as much as the writes
+// that called for them
+constexpr size_t kSweepFraction = 4;
+
+// Spilled lists are stored as each element's 4 byte little endian length
+// followed by its bytes, the same way bulk_load's binary format does it
+string encode_list(const vector<string>& elems) {
+  string data;
+  for (const auto& elem : elems) {
+    uint32_t len = static_cast<uint32_t>(elem.size());
+    for (int i = 0; i < 4; i++) {
+      data.push_back(static_cast<char>((len >> (8 * i)) & 0xff));
+    }
+    data += elem;
+  }
+  return data;
+}
+
+optional<vector<string>> decode_list(const string& data) {
+  vector<string> elems;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    if (data.size() - pos < 4) {
+      return nullopt;
+    }
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&data[pos]);
+    size_t len = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+                 (static_cast<uint32_t>(bytes[3]) << 24);
+    pos += 4;
+    if (data.size() - pos < len) {
+      return nullopt;
+    }
+    elems.emplace_back(data, pos, len);
+    pos += len;
+  }
+  return elems;
+}
+
+}  // namespace
+
+bool SimpleKV::enable_tiering(const string& nspace,
+                              const string& path,
+                              size_t memory_budget,
+                              size_t min_value_bytes) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto iter = tiers.find(nspace);
+  if (iter == tiers.end()) {
+    auto log = make_shared<SpillLog>(path);
+    if (!log->ok()) {
+      return false;
+    }
+    iter = tiers.emplace(nspace, Tier{}).first;
+    iter->second.log = move(log);
+  } else if (!iter->second.log->same_file(path)) {
+    // moving the log would mean copying every spilled value over, leave
+    // that to disable_tiering and a fresh enable_tiering
+    return false;
+  }
+  generation++;
+  iter->second.memory_budget = memory_budget;
+  iter->second.min_value_bytes = min_value_bytes;
+  // the namespace may already be over the new budget, and a new threshold
+  // changes which values count
+  iter->second.recount = true;
+  sweep(nspace, iter->second);
+  return true;
+}
+
+bool SimpleKV::disable_tiering(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  auto iter = tiers.find(nspace);
+  if (iter == tiers.end()) {
+    return true;
+  }
+  auto& tier = iter->second;
+  auto first_iter = kv_store.find(nspace);
+  // a namespace with nothing on disk is left as it is, shared or not
+  bool spilled = first_iter != kv_store.end() &&
+                 any_of(first_iter->second->begin(),
+                        first_iter->second->end(), [](const auto& keypair) {
+                          return holds_alternative<SpilledValue>(
+                              *keypair.second);
+                        });
+  if (spilled) {
+    // read everything back before touching the store, so that a failed
+    // read leaves the namespace as it was
+    vector<pair<SharedValue*, ValueType>> loaded;
+    for (auto& keypair : writable(first_iter->second)) {
+      if (!holds_alternative<SpilledValue>(*keypair.second)) {
+        continue;
+      }
+      auto plain = read_spilled(nspace, get<SpilledValue>(*keypair.second));
+      if (!plain) {
+        return false;
+      }
+      loaded.emplace_back(&keypair.second, move(*plain));
+    }
+    // clones may still be using the log, so let go of our records. A value
+    // a clone holds too keeps its record, the clone still reads it.
+    for (auto& pair : loaded) {
+      if (!pair.first->shared()) {
+        tier.log->release(get<SpilledValue>(**pair.first).id);
+      }
+      *pair.first = encode_loaded(nspace, move(pair.second));
+    }
+  }
+  tiers.erase(iter);
+  generation++;
+  return true;
+}
+
+TierStats SimpleKV::tier_stats(const string& nspace) {
+  lock_guard<recursive_mutex> lock(mtx);
+  TierStats stats;
+  auto iter = tiers.find(nspace);
+  if (iter == tiers.end()) {
+    return stats;
+  }
+  const auto& tier = iter->second;
+  stats.spilled_bytes = tier.log->live_bytes();
+  stats.log_bytes = tier.log->file_bytes();
+  stats.spills = tier.spills;
+  stats.faults = tier.faults;
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return stats;
+  }
+  for (const auto& keypair : *first_iter->second) {
+    if (holds_alternative<SpilledValue>(*keypair.second)) {
+      stats.spilled_values++;
+      continue;
+    }
+    size_t bytes = value_bytes(*keypair.second);
+    if (bytes >= tier.min_value_bytes) {
+      stats.resident_bytes += bytes;
+    }
+  }
+  return stats;
+}
+
+// private helpers
+
+void SimpleKV::tier_access(const string& nspace, const string& key, bool load) {
+  // the common case is no tiering at all, keep that to one branch
+  if (tiers.empty()) {
+    return;
+  }
+  auto tier_iter = tiers.find(nspace);
+  if (tier_iter == tiers.end()) {
+    return;
+  }
+  auto& tier = tier_iter->second;
+  // sweep before loading, so the sweep can't spill the value the caller
+  // is about to use
+  if (tier.since_sweep > tier.memory_budget / kSweepFraction) {
+    sweep(nspace, tier);
+  }
+  tier.touch(key);
+  if (!load) {
+    return;
+  }
+  auto first_iter = kv_store.find(nspace);
+  if (first_iter == kv_store.end()) {
+    return;
+  }
+  auto key_iter = first_iter->second->find(key);
+  if (key_iter == first_iter->second->end() ||
+      !holds_alternative<SpilledValue>(*key_iter->second)) {
+    return;
+  }
+  auto stub = get<SpilledValue>(*key_iter->second);
+  auto plain = read_spilled(nspace, stub);
+  if (!plain) {
+    return;
+  }
+  // reading it back changes the keys, so they may have to be copied first
+  if (first_iter->second.use_count() > 1) {
+    key_iter = writable(first_iter->second).find(key);
+  }
+  // a value a clone holds too keeps its record for the clone
+  if (!key_iter->second.shared()) {
+    tier.log->release(stub.id);
+  }
+  tier.since_sweep += value_bytes(*plain);
+  tier.faults++;
+  key_iter->second = encode_loaded(nspace, move(*plain));
+}
+
+void SimpleKV::tier_written(const string& nspace, size_t bytes) {
+  if (tiers.empty()) {
+    return;
+  }
+  auto tier_iter = tiers.find(nspace);
+  if (tier_iter != tiers.end()) {
+    tier_iter->second.since_sweep += bytes;
+  }
+}
+
+void SimpleKV::discard_spilled(const string& nspace,
+                               const SharedValue& value) {
+  if (value.shared() || !holds_alternative<SpilledValue>(*value)) {
+    return;
+  }
+  auto tier_iter = tiers.find(nspace);
+  if (tier_iter != tiers.end()) {
+    tier_iter->second.log->release(get<SpilledValue>(*value).id);
+  }
+}
+
+void SimpleKV::sweep(const string& nspace, Tier& tier) {
+  tier.since_sweep = 0;
+  auto first_iter = kv_store.find(nspace);
+  // spilling keys shared with a clone would mean copying them, which costs
+  // more memory than spilling saves
+  if (first_iter == kv_store.end() || first_iter->second.use_count() > 1) {
+    return;
+  }
+  auto& key_map = *first_iter->second;
+  // what a key holds in memory, 0 if it is gone or spilled. Values a clone
+  // holds too count as 0 as well, spilling our copy wouldn't free them.
+  auto resident_bytes_of = [&](const string& key) -> size_t {
+    auto key_iter = key_map.find(key);
+    if (key_iter == key_map.end() || key_iter->second.shared() ||
+        holds_alternative<SpilledValue>(*key_iter->second)) {
+      return 0;
+    }
+    return value_bytes(*key_iter->second);
+  };
+  if (tier.recount) {
+    // keys nobody has used yet go in front of the ones that were, and the
+    // ones already counted are counted again
+    for (const auto& keypair : key_map) {
+      if (keypair.second.shared() ||
+          holds_alternative<SpilledValue>(*keypair.second)) {
+        continue;
+      }
+      size_t bytes = value_bytes(*keypair.second);
+      if (bytes < tier.min_value_bytes) {
+        continue;
+      }
+      auto pos = tier.positions.find(keypair.first);
+      if (pos == tier.positions.end()) {
+        tier.recency.push_front(Tier::Resident{keypair.first, bytes, true});
+        tier.positions.emplace(tier.recency.front().key,
+                               tier.recency.begin());
+        tier.resident_bytes += bytes;
+      } else if (pos->second->counted) {
+        tier.resident_bytes += bytes - pos->second->bytes;
+        pos->second->bytes = bytes;
+      }
+    }
+    tier.recount = false;
+  }
+  // count the keys used since the last sweep, they are the newest entries
+  auto iter = tier.recency.end();
+  while (iter != tier.recency.begin()) {
+    --iter;
+    if (iter->counted) {
+      break;
+    }
+    size_t bytes = resident_bytes_of(iter->key);
+    if (bytes < tier.min_value_bytes) {
+      iter = tier.forget(iter);
+      continue;
+    }
+    iter->bytes = bytes;
+    iter->counted = true;
+    tier.resident_bytes += bytes;
+  }
+  // then spill from the least recently used end until the rest fit
+  while (tier.resident_bytes > tier.memory_budget && !tier.recency.empty()) {
+    auto oldest = tier.recency.begin();
+    tier.resident_bytes -= oldest->bytes;
+    auto key_iter = key_map.find(oldest->key);
+    // the key may have gone, shrunk or been shared with a clone since it
+    // was counted
+    if (key_iter == key_map.end() || key_iter->second.shared() ||
+        holds_alternative<SpilledValue>(*key_iter->second) ||
+        value_bytes(*key_iter->second) < tier.min_value_bytes) {
+      tier.forget(oldest);
+      continue;
+    }
+    const auto& value = *key_iter->second;
+    auto str = string_of(nspace, value);
+    bool is_list = !str;
+    auto id = tier.log->append(is_list ? encode_list(elements_of(nspace, value))
+                                       : *str);
+    // the disk is full or failing, keep everything else in memory
+    if (!id) {
+      tier.resident_bytes += oldest->bytes;
+      break;
+    }
+    key_iter->second = SpilledValue{*id, is_list};
+    tier.forget(oldest);
+    tier.spills++;
+  }
+}
+
+void SimpleKV::Tier::touch(const string& key) {
+  auto pos = positions.find(key);
+  if (pos == positions.end()) {
+    recency.push_back(Resident{key});
+    positions.emplace(recency.back().key, prev(recency.end()));
+    return;
+  }
+  auto iter = pos->second;
+  if (iter->counted) {
+    resident_bytes -= iter->bytes;
+    iter->counted = false;
+  }
+  recency.splice(recency.end(), recency, iter);
+}
+
+list<SimpleKV::Tier::Resident>::iterator SimpleKV::Tier::forget(
+    list<Resident>::iterator iter) {
+  positions.erase(iter->key);
+  return recency.erase(iter);
+}
+
+optional<SimpleKV::ValueType> SimpleKV::read_spilled(
+    const string& nspace,
+    const SpilledValue& stub) const {
+  auto tier_iter = tiers.find(nspace);
+  if (tier_iter == tiers.end()) {
+    return nullopt;
+  }
+  auto data = tier_iter->second.log->read(stub.id);
+  if (!data) {
+    return nullopt;
+  }
+  if (!stub.is_list) {
+    return ValueType(move(*data));
+  }
+  auto elems = decode_list(*data);
+  if (!elems) {
+    return nullopt;
+  }
+  return ValueType(move(*elems));
+}
+
+size_t SimpleKV::value_bytes(const ValueType& value) {
+  if (holds_alternative<string>(value)) {
+    return get<string>(value).size();
+  }
+  if (holds_alternative<CompressedString>(value)) {
+    return get<CompressedString>(value).data.size();
+  }
+  if (holds_alternative<InternedString>(value)) {
+    return get<InternedString>(value).str().size();
+  }
+  if (holds_alternative<CompressedList>(value)) {
+    return get<CompressedList>(value).stored_bytes();
+  }
+  size_t bytes = 0;
+  if (holds_alternative<vector<string>>(value)) {
+    for (const auto& elem : get<vector<string>>(value)) {
+      bytes += elem.size();
+    }
+  } else if (holds_alternative<InternedList>(value)) {
+    for (const auto& elem : get<InternedList>(value)) {
+      bytes += elem.str().size();
+    }
+  }
+  return bytes;
+}
+
+}  // namespace simplekv
@@ -0,0 +1,238 @@
+#ifndef TYPEDNAMESPACE_HPP_
+#define TYPEDNAMESPACE_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace simplekv {
+
+// The part of a typed namespace that doesn't depend on its value type,
+// so that SimpleKV can hold typed namespaces of different types together
+class TypedNamespaceBase {
+ public:
+  virtual ~TypedNamespaceBase() = default;
+
+  // Returns the type of the values stored in the namespace
+  virtual const std::type_info& value_type() const = 0;
+
+  // Returns a copy of the namespace, for SimpleKV::clone()
+  virtual std::unique_ptr<TypedNamespaceBase> clone() = 0;
+};
+
+// A namespace whose values are all of type T, stored in their native
+// binary layout instead of as strings. Created by SimpleKV::typed<T>().
+//
+// The values live packed together in one vector, and a map from key to
+// slot finds them. Deleting a key moves the last value into its slot so
+// the vector never has holes.
+//
+// T has to be trivially copyable: integers, floating point numbers, and
+// plain structs of those. bool is stored as a byte so that we never get
+// the std::vector<bool> specialization.
+//
+// All operations are safe to call from several threads at once.
+template <typename T>
+class TypedNamespace : public TypedNamespaceBase {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "typed namespaces store values in their binary layout");
+
+ public:
+  TypedNamespace() = default;
+
+  TypedNamespace(const TypedNamespace& other) = delete;
+  TypedNamespace(TypedNamespace&& other) = delete;
+  TypedNamespace& operator=(const TypedNamespace& other) = delete;
+  TypedNamespace& operator=(TypedNamespace&& other) = delete;
+  ~TypedNamespace() override = default;
+
+  const std::type_info& value_type() const override { return typeid(T); }
+
+  std::unique_ptr<TypedNamespaceBase> clone() override {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto copy = std::make_unique<TypedNamespace<T>>();
+    copy->values = values;
+    // slot_keys point into our own index, so the copy builds its own
+    copy->index.reserve(index.size());
+    for (size_t slot = 0; slot < slot_keys.size(); slot++) {
+      auto inserted = copy->index.emplace(*slot_keys[slot], slot).first;
+      copy->slot_keys.push_back(&inserted->first);
+    }
+    return copy;
+  }
+
+  // Gets the value stored at the key
+  //
+  // Returns:
+  // - nullopt if the key doesn't exist
+  // - a copy of the value otherwise
+  std::optional<T> get(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto iter = index.find(key);
+    if (iter == index.end()) {
+      return std::nullopt;
+    }
+    return static_cast<T>(values[iter->second]);
+  }
+
+  // Sets the key to the value, creating the key if it doesn't exist
+  void set(const std::string& key, const T& value) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto iter = index.find(key);
+    if (iter != index.end()) {
+      values[iter->second] = value;
+      return;
+    }
+    auto inserted = index.emplace(key, values.size()).first;
+    values.push_back(value);
+    slot_keys.push_back(&inserted->first);
+  }
+
+  // Deletes the key
+  //
+  // Returns:
+  // - true iff the key existed
+  bool del(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto iter = index.find(key);
+    if (iter == index.end()) {
+      return false;
+    }
+    // fill the hole with the last value so the storage stays packed
+    size_t slot = iter->second;
+    size_t last = values.size() - 1;
+    if (slot != last) {
+      values[slot] = values[last];
+      slot_keys[slot] = slot_keys[last];
+      index[*slot_keys[slot]] = slot;
+    }
+    values.pop_back();
+    slot_keys.pop_back();
+    index.erase(iter);
+    return true;
+  }
+
+  // Returns true iff the key exists
+  bool exists(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return index.find(key) != index.end();
+  }
+
+  // Returns the names of every key in the namespace
+  std::vector<std::string> keys() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<std::string> res;
+    res.reserve(slot_keys.size());
+    for (const auto* key : slot_keys) {
+      res.push_back(*key);
+    }
+    return res;
+  }
+
+  // Returns the number of keys in the namespace
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return values.size();
+  }
+
+  // Runs fn on the value stored at the key, in place and atomically with
+  // respect to every other operation on this namespace
+  //
+  // Arguments:
+  // - key: the key whose value we want to modify
+  // - fn: called with a T& to the stored value
+  //
+  // Returns:
+  // - true iff the key existed
+  template <typename Fn>
+  bool update(const std::string& key, Fn fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto iter = index.find(key);
+    if (iter == index.end()) {
+      return false;
+    }
+    T value = static_cast<T>(values[iter->second]);
+    fn(value);
+    values[iter->second] = value;
+    return true;
+  }
+
+  // Atomically adds delta to the number stored at the key. A key that
+  // doesn't exist starts at zero. Integers wrap around on overflow.
+  //
+  // Returns:
+  // - the new value
+  template <typename U = T>
+  std::enable_if_t<std::is_arithmetic<U>::value && !std::is_same<U, bool>::value,
+                   T>
+  add(const std::string& key, T delta) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto iter = index.find(key);
+    if (iter == index.end()) {
+      iter = index.emplace(key, values.size()).first;
+      values.push_back(T{});
+      slot_keys.push_back(&iter->first);
+    }
+    T& value = values[iter->second];
+    value = sum(value, delta);
+    return value;
+  }
+
+  // Atomically adds one to / subtracts one from the number stored at the
+  // key, see add()
+  template <typename U = T>
+  std::enable_if_t<std::is_arithmetic<U>::value && !std::is_same<U, bool>::value,
+                   T>
+  incr(const std::string& key) {
+    return add(key, T{1});
+  }
+
+  template <typename U = T>
+  std::enable_if_t<std::is_arithmetic<U>::value && !std::is_same<U, bool>::value,
+                   T>
+  decr(const std::string& key) {
+    return sub(key);
+  }
+
+ private:
+  // bool is the one type std::vector doesn't store natively
+  using Stored = std::conditional_t<std::is_same<T, bool>::value, uint8_t, T>;
+
+  // a + b, wrapping around for integers instead of overflowing
+  static T sum(T a, T b) {
+    if constexpr (std::is_integral<T>::value) {
+      using Unsigned = std::make_unsigned_t<T>;
+      return static_cast<T>(static_cast<Unsigned>(a) +
+                            static_cast<Unsigned>(b));
+    } else {
+      return a + b;
+    }
+  }
+
+  // decrements the key, negating one isn't an option for unsigned types
+  T sub(const std::string& key) {
+    if constexpr (std::is_integral<T>::value) {
+      return add(key, static_cast<T>(~std::make_unsigned_t<T>{0}));
+    } else {
+      return add(key, T{-1});
+    }
+  }
+
+  std::mutex mtx;
+  // key -> slot in values
+  std::unordered_map<std::string, size_t> index;
+  std::vector<Stored> values;
+  // slot -> key, pointing at the keys in index (which never move), so that
+  // del can find the key of the value it moves
+  std::vector<const std::string*> slot_keys;
+};
+
+}  // namespace simplekv
+
+#endif  // TYPEDNAMESPACE_HPP_
@@ -0,0 +1,85 @@
+#include "./ValueIndex.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace simplekv {
+
+ValueIndex::ValueIndex(const ValueIndex& other) : strings(other.strings) {
+  for (const auto& pair : other.elements) {
+    auto& holders = elements[pair.first];
+    for (const auto& key_count : pair.second) {
+      holders.emplace(list_keys.intern(key_count.first.str()),
+                      key_count.second);
+    }
+  }
+}
+
+void ValueIndex::add_string(const string& key, const string& value) {
+  strings[value].insert(key);
+}
+
+void ValueIndex::remove_string(const string& key, const string& value) {
+  auto iter = strings.find(value);
+  if (iter == strings.end()) {
+    return;
+  }
+  iter->second.erase(key);
+  // don't keep empty sets around for values nobody holds anymore
+  if (iter->second.empty()) {
+    strings.erase(iter);
+  }
+}
+
+void ValueIndex::add_element(const string& key, const string& elem) {
+  elements[elem][list_keys.intern(key)]++;
+}
+
+void ValueIndex::remove_element(const string& key, const string& elem) {
+  auto iter = elements.find(elem);
+  if (iter == elements.end()) {
+    return;
+  }
+  // interning a key that isn't held anywhere adds it to the pool only for
+  // as long as the handle lives
+  auto key_iter = iter->second.find(list_keys.intern(key));
+  if (key_iter == iter->second.end()) {
+    return;
+  }
+  if (--key_iter->second == 0) {
+    iter->second.erase(key_iter);
+    if (iter->second.empty()) {
+      elements.erase(iter);
+    }
+  }
+}
+
+vector<string> ValueIndex::keys_with_value(const string& value) const {
+  auto iter = strings.find(value);
+  if (iter == strings.end()) {
+    return {};
+  }
+  return vector<string>(iter->second.begin(), iter->second.end());
+}
+
+vector<string> ValueIndex::lists_containing(const string& elem) const {
+  vector<string> res{};
+  auto iter = elements.find(elem);
+  if (iter == elements.end()) {
+    return res;
+  }
+  for (const auto& pair : iter->second) {
+    res.push_back(pair.first.str());
+  }
+  return res;
+}
+
+void ValueIndex::clear() {
+  strings.clear();
+  elements.clear();
+}
+
+}  // namespace simplekv
@@ -0,0 +1,63 @@
+#ifndef VALUEINDEX_HPP_
+#define VALUEINDEX_HPP_
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "./StringPool.hpp"
+
+namespace simplekv {
+
+// A reverse index over the values of one namespace: which keys hold a
+// given string value, and which lists contain a given element.
+//
+// The owner keeps it up to date by reporting every value and element that
+// is added to or removed from the namespace.
+//
+// A list key is recorded once for every distinct element of its list, so
+// the index holds list keys as handles into its own pool rather than as a
+// copy per element. A string key is recorded once, and is kept as is.
+class ValueIndex {
+ public:
+  ValueIndex() = default;
+
+  // A copy interns the list keys again into a pool of its own, so the copy and
+  // the original never share a handle
+  ValueIndex(const ValueIndex& other);
+  ValueIndex& operator=(const ValueIndex& other) = delete;
+
+  // Records that the key now holds / no longer holds the string value
+  void add_string(const std::string& key, const std::string& value);
+  void remove_string(const std::string& key, const std::string& value);
+
+  // Records one more / one fewer copy of elem in the list at the key
+  void add_element(const std::string& key, const std::string& elem);
+  void remove_element(const std::string& key, const std::string& elem);
+
+  // Gets the keys whose string value is exactly value
+  std::vector<std::string> keys_with_value(const std::string& value) const;
+
+  // Gets the keys whose list contains elem at least once
+  std::vector<std::string> lists_containing(const std::string& elem) const;
+
+  // Forgets everything in the index
+  void clear();
+
+ private:
+  // the keys of the lists. Declared before the maps so that it is
+  // destroyed after the handles in them.
+  StringPool list_keys;
+  // value -> keys holding it
+  std::unordered_map<std::string, std::unordered_set<std::string>> strings;
+  // element -> keys of the lists holding it -> how many times. Lists can
+  // hold an element more than once, and popping one copy must not drop the
+  // key from the index.
+  std::unordered_map<std::string, std::unordered_map<InternedString, size_t>>
+      elements;
+};
+
+}  // namespace simplekv
+
+#endif  // VALUEINDEX_HPP_
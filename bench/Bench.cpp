@@ -0,0 +1,727 @@
+// The benchmarks of every feature, in one driver.
+//
+// Build and run from the repository root:
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/Bench.cpp *.cpp -o /tmp/bench
+//   /tmp/bench                 run every benchmark
+//   /tmp/bench cluster 4       run one benchmark, with 4 times the work
+//
+// Every benchmark prints one line per measurement. The numbers are only
+// meant to be compared with each other on the same machine.
+
+#include <malloc.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./KVCluster.hpp"
+#include "./Query.hpp"
+#include "./SimpleKV.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+// Measures the wall clock time since it was constructed
+class Timer {
+ public:
+  Timer() : start(chrono::steady_clock::now()) {}
+
+  double seconds() const {
+    return chrono::duration<double>(chrono::steady_clock::now() - start)
+        .count();
+  }
+
+ private:
+  chrono::steady_clock::time_point start;
+};
+
+void report(const string& what, double value, const char* unit) {
+  printf("  %-44s %12.1f %s\n", what.c_str(), value, unit);
+}
+
+// Gets how much CPU time the calling thread has used
+double thread_cpu_seconds() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<double>(now.tv_sec) + now.tv_nsec / 1e9;
+}
+
+// Gets how many bytes the heap has handed out and not taken back
+double heap_bytes() {
+  return static_cast<double>(mallinfo2().uordblks);
+}
+
+// Reports how long each of ops operations took on average
+void report_per_op(const string& what, const Timer& timer, size_t ops) {
+  report(what, timer.seconds() * 1e9 / static_cast<double>(ops), "ns/op");
+}
+
+// The cost of routing through the cluster from 1 to 8 nodes, and of
+// rebalancing when a node joins. All nodes are local, so this measures the
+// router and not the network.
+//
+// Every operation here finds its key by hash. sget would not do: it scans
+// its namespace, so smaller nodes would look faster for scanning less,
+// which says nothing about the router. Each cluster is compared against a
+// single store of one node's size, and with one thread per node against a
+// single store shared by as many threads, since each node has its own lock.
+void bench_cluster(size_t scale) {
+  const size_t keys = 100000 * scale;
+  // sset and then type on every key in [first, last)
+  auto work = [](auto& store, const string& nspace, size_t first,
+                 size_t last) {
+    for (size_t i = first; i < last; i++) {
+      store.sset(nspace, "k" + to_string(i), "v");
+    }
+    for (size_t i = first; i < last; i++) {
+      store.type(nspace, "k" + to_string(i));
+    }
+  };
+  // the same work split over threads, each on its own keys
+  auto work_threaded = [&](auto& store, size_t threads) {
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        work(store, "t", keys * t / threads, keys * (t + 1) / threads);
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  };
+  for (size_t nodes = 1; nodes <= 8; nodes *= 2) {
+    const string name = to_string(nodes) + (nodes == 1 ? " node" : " nodes");
+    {
+      SimpleKV shard;
+      Timer timer;
+      work(shard, "n", 0, keys / nodes);
+      report_per_op(name + ", one node's keys in one store", timer,
+                    2 * (keys / nodes));
+    }
+    vector<unique_ptr<SimpleKV>> stores;
+    KVCluster cluster;
+    for (size_t i = 0; i < nodes; i++) {
+      stores.push_back(make_unique<SimpleKV>());
+      cluster.add_node("node" + to_string(i), stores.back().get());
+    }
+    Timer timer;
+    work(cluster, "n", 0, keys);
+    report_per_op(name + ", all keys through the cluster", timer, 2 * keys);
+
+    {
+      SimpleKV shared;
+      Timer threaded;
+      work_threaded(shared, nodes);
+      report_per_op(name + ", " + to_string(nodes) + " threads on one store",
+                    threaded, 2 * keys);
+    }
+    Timer threaded;
+    work_threaded(cluster, nodes);
+    report_per_op(name + ", " + to_string(nodes) + " threads on the cluster",
+                  threaded, 2 * keys);
+
+    SimpleKV joining;
+    Timer rebalance;
+    cluster.add_node("joining", &joining);
+    report_per_op(name + ", rebalance on join (per key)", rebalance,
+                  2 * keys);
+  }
+}
+
+// How long a parked consumer takes to see a push, and how much CPU an idle
+// consumer burns, for blpop against polling lpop in a loop
+void bench_blocking(size_t scale) {
+  const int rounds = 200 * static_cast<int>(scale);
+  for (bool blocking : {true, false}) {
+    const char* how = blocking ? "blpop" : "polling lpop";
+    SimpleKV kv;
+    atomic<bool> stop{false};
+    atomic<int64_t> pushed_at{0};
+    double latency_total = 0;
+    double cpu = 0;
+    atomic<int> received{0};
+    thread consumer([&] {
+      double cpu_start = thread_cpu_seconds();
+      while (!stop.load()) {
+        auto value = blocking ? kv.blpop("n", "q", chrono::milliseconds(50))
+                              : kv.lpop("n", "q");
+        if (!value) {
+          continue;
+        }
+        auto now = chrono::steady_clock::now().time_since_epoch();
+        latency_total +=
+            static_cast<double>(chrono::nanoseconds(now).count() -
+                                pushed_at.load());
+        received++;
+      }
+      cpu = thread_cpu_seconds() - cpu_start;
+    });
+    // idle for a while with nothing in the queue, then push one value at a
+    // time and wait for it to be taken
+    this_thread::sleep_for(chrono::milliseconds(200));
+    for (int i = 0; i < rounds; i++) {
+      pushed_at = chrono::nanoseconds(
+                      chrono::steady_clock::now().time_since_epoch())
+                      .count();
+      kv.rpush("n", "q", "job");
+      while (received.load() <= i) {
+        this_thread::yield();
+      }
+    }
+    stop = true;
+    consumer.join();
+    report(string(how) + ", wakeup latency", latency_total / rounds / 1e3,
+           "us");
+    report(string(how) + ", consumer CPU over the run", cpu * 1e3, "ms");
+  }
+}
+
+// Text that compresses about as well as typical JSON
+string json_blob(size_t bytes, size_t seed) {
+  string res = "{";
+  for (size_t i = 0; res.size() < bytes; i++) {
+    res += "\"field" + to_string(i % 50) + "\": \"value-" +
+           to_string((seed + i) % 7) + "\", ";
+  }
+  res.resize(bytes);
+  return res;
+}
+
+// Write and read cost of compressed strings and lists against plain ones,
+// and the memory saved
+void bench_compression(size_t scale) {
+  const size_t blobs = 200 * scale;
+  const size_t elems = 20000 * scale;
+  for (bool compressed : {false, true}) {
+    const string how = compressed ? "compressed" : "plain";
+    SimpleKV kv;
+    if (compressed) {
+      kv.enable_compression("n");
+    }
+    Timer write_strings;
+    for (size_t i = 0; i < blobs; i++) {
+      kv.sset("n", "blob" + to_string(i), json_blob(100000, i));
+    }
+    report_per_op(how + ", sset of 100 KB strings", write_strings, blobs);
+    Timer read_strings;
+    for (size_t i = 0; i < blobs; i++) {
+      kv.sget("n", "blob" + to_string(i));
+    }
+    report_per_op(how + ", sget of 100 KB strings", read_strings, blobs);
+
+    Timer write_list;
+    for (size_t i = 0; i < elems; i++) {
+      kv.rpush("n", "list", "status=ok tenant=" + to_string(i % 16));
+    }
+    report_per_op(how + ", rpush of similar elements", write_list, elems);
+    Timer read_list;
+    for (size_t i = 0; i < elems; i += 7) {
+      kv.lindex("n", "list", i);
+    }
+    report_per_op(how + ", lindex", read_list, elems / 7);
+
+    if (compressed) {
+      auto stats = kv.compression_stats("n");
+      report("compressed bytes before", stats.raw_bytes / 1e6, "MB");
+      report("compressed bytes after", stats.stored_bytes / 1e6, "MB");
+      report("compression ratio", stats.ratio(), "x");
+    }
+  }
+}
+
+// Memory and throughput of interned lists on a dataset where the same few
+// values repeat, against plain lists
+void bench_interning(size_t scale) {
+  const size_t lists = 1000;
+  const size_t elems = 200 * scale;
+  for (bool interned : {false, true}) {
+    const string how = interned ? "interned" : "plain";
+    double heap_before = heap_bytes();
+    {
+      SimpleKV kv;
+      if (interned) {
+        kv.enable_interning("n");
+      }
+      Timer write;
+      for (size_t i = 0; i < lists * elems; i++) {
+        kv.rpush("n", "list" + to_string(i % lists),
+                 "tenant-0000000000000000-" + to_string(i % 32));
+      }
+      report_per_op(how + ", rpush", write, lists * elems);
+      report(how + ", heap after loading", (heap_bytes() - heap_before) / 1e6,
+             "MB");
+      Timer inter;
+      for (size_t i = 0; i < lists; i++) {
+        kv.linter("n", "list" + to_string(i), "n",
+                  "list" + to_string((i + 1) % lists));
+      }
+      report_per_op(how + ", linter of two lists", inter, lists);
+    }
+  }
+}
+
+// A counter kept in a typed namespace against the same counter kept as a
+// string and parsed on every increment, and reading a fixed size record
+// against reading its text form
+void bench_typed(size_t scale) {
+  const size_t keys = 1000;
+  const size_t ops = 200000 * scale;
+  {
+    SimpleKV kv;
+    auto* counters = kv.typed<int64_t>("counters");
+    Timer timer;
+    for (size_t i = 0; i < ops; i++) {
+      counters->incr("c" + to_string(i % keys));
+    }
+    report_per_op("typed, incr", timer, ops);
+  }
+  {
+    SimpleKV kv;
+    Timer timer;
+    for (size_t i = 0; i < ops; i++) {
+      string key = "c" + to_string(i % keys);
+      auto value = kv.sget("counters", key);
+      int64_t count = value ? stoll(*value) : 0;
+      kv.sset("counters", key, to_string(count + 1));
+    }
+    report_per_op("strings, sget+parse+sset", timer, ops);
+  }
+
+  struct Sample {
+    int64_t at;
+    double value;
+    int32_t sensor;
+  };
+  {
+    SimpleKV kv;
+    auto* samples = kv.typed<Sample>("samples");
+    for (size_t i = 0; i < keys; i++) {
+      samples->set("s" + to_string(i), Sample{int64_t(i), i * 0.5, int32_t(i)});
+    }
+    Timer timer;
+    double sum = 0;
+    for (size_t i = 0; i < ops; i++) {
+      sum += samples->get("s" + to_string(i % keys))->value;
+    }
+    report_per_op("typed, record get", timer, ops);
+    report("typed, bytes per record", sizeof(Sample), "B");
+  }
+  {
+    SimpleKV kv;
+    for (size_t i = 0; i < keys; i++) {
+      kv.sset("samples", "s" + to_string(i),
+              to_string(i) + " " + to_string(i * 0.5) + " " + to_string(i));
+    }
+    Timer timer;
+    double sum = 0;
+    for (size_t i = 0; i < ops; i++) {
+      auto text = kv.sget("samples", "s" + to_string(i % keys));
+      sum += stod(text->substr(text->find(' ') + 1));
+    }
+    report_per_op("strings, record sget+parse", timer, ops);
+  }
+}
+
+// The throughput of bulk_load from one thread up to one per core, against
+// pushing the same records one call at a time
+void bench_bulk_load(size_t scale) {
+  const size_t records = 500000 * scale;
+  string input;
+  for (size_t i = 0; i < records; i++) {
+    input += (i % 4 == 0 ? "S\tn" : "R\tn") + to_string(i % 8) + "\tk" +
+             to_string(i % 50000) + "\tvalue-" + to_string(i) + "\n";
+  }
+  {
+    SimpleKV kv;
+    Timer timer;
+    for (size_t i = 0; i < records; i++) {
+      string nspace = "n" + to_string(i % 8);
+      string key = "k" + to_string(i % 50000);
+      if (i % 4 == 0) {
+        kv.sset(nspace, key, "value-" + to_string(i));
+      } else {
+        kv.rpush(nspace, key, "value-" + to_string(i));
+      }
+    }
+    report_per_op("sset/rpush one at a time", timer, records);
+  }
+  // past the core count the extra threads only show the cost of the
+  // routing between workers
+  size_t most = max<size_t>(4, thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= most; threads *= 2) {
+    SimpleKV kv;
+    stringstream in(input);
+    Timer timer;
+    kv.bulk_load(in, bulk_format::lines, threads);
+    report_per_op("bulk_load, " + to_string(threads) + " threads", timer,
+                  records);
+  }
+}
+
+// A parallel aggregation over every value from one worker up to one per
+// core, against the same sum through the string API, and the fixed cost of
+// running a query over an empty store.
+//
+// The default is 2e5 keys so that a run of every benchmark stays short.
+// The 1e7 keys the query engine was sized for are scale 50, `bench query
+// 50`, which needs about 1.8 GB and a few minutes, most of them in the
+// sget sample since every sget scans its namespace.
+void bench_query(size_t scale) {
+  const size_t keys = 200000 * scale;
+  SimpleKV kv;
+  for (size_t i = 0; i < keys; i++) {
+    kv.sset("n" + to_string(i % 4), "k" + to_string(i), to_string(i % 1000));
+  }
+  auto sum_values = [](QueryEngine& engine) {
+    return engine.map_reduce(
+        nullopt,
+        [](const string&, const string&, const ValueRef&) { return true; },
+        [](const string&, const string&, const ValueRef& value) {
+          auto view = value.view();
+          return view ? static_cast<int64_t>(view->size()) : int64_t{0};
+        },
+        [](int64_t a, int64_t b) { return a + b; }, int64_t{0});
+  };
+  {
+    // sget finds its key with a scan, so only time a sample of the keys,
+    // spread out so that it isn't just the ones the scan reaches first
+    const size_t sample = 200;
+    auto names = kv.keys("n0");
+    Timer timer;
+    int64_t sum = 0;
+    for (size_t i = 0; i < sample; i++) {
+      const auto& key = names[i * names.size() / sample];
+      sum += static_cast<int64_t>(kv.sget("n0", key)->size());
+    }
+    report_per_op("sget of every key, per value", timer, sample);
+  }
+  size_t most = max<size_t>(4, thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= most; threads *= 2) {
+    QueryEngine engine(kv, threads);
+    sum_values(engine);
+    Timer timer;
+    for (int round = 0; round < 5; round++) {
+      sum_values(engine);
+    }
+    report_per_op("map_reduce, " + to_string(threads) + " threads, per value",
+                  timer, 5 * keys);
+  }
+  {
+    SimpleKV empty;
+    QueryEngine engine(empty, 4);
+    const size_t rounds = 20000;
+    Timer timer;
+    for (size_t i = 0; i < rounds; i++) {
+      sum_values(engine);
+    }
+    report_per_op("map_reduce over an empty store", timer, rounds);
+  }
+}
+
+// What a value index adds to every write and to memory, and what it saves
+// on find_by_value and find_lists_containing against a scan
+void bench_index(size_t scale) {
+  const size_t keys = 50000 * scale;
+  const size_t lookups = 200;
+  for (bool indexed : {false, true}) {
+    const string how = indexed ? "indexed" : "scanned";
+    SimpleKV kv;
+    if (indexed) {
+      kv.enable_value_index("n");
+    }
+    double heap_before = heap_bytes();
+    Timer write;
+    for (size_t i = 0; i < keys; i++) {
+      kv.sset("n", "s" + to_string(i), "status-" + to_string(i % 100));
+    }
+    for (size_t i = 0; i < keys; i++) {
+      kv.rpush("n", "l" + to_string(i % 1000), "tag-" + to_string(i % 499));
+    }
+    report_per_op(how + ", sset+rpush", write, 2 * keys);
+    report(how + ", memory held", (heap_bytes() - heap_before) / 1e6, "MB");
+    Timer pop;
+    for (size_t i = 0; i < keys / 2; i++) {
+      kv.lpop("n", "l" + to_string(i % 1000));
+    }
+    report_per_op(how + ", lpop", pop, keys / 2);
+
+    Timer find;
+    size_t found = 0;
+    for (size_t i = 0; i < lookups; i++) {
+      found += kv.find_by_value("n", "status-" + to_string(i % 100)).size();
+    }
+    report_per_op(how + ", find_by_value", find, lookups);
+    Timer contains;
+    for (size_t i = 0; i < lookups; i++) {
+      found +=
+          kv.find_lists_containing("n", "tag-" + to_string(i % 499)).size();
+    }
+    report_per_op(how + ", find_lists_containing", contains, lookups);
+  }
+}
+
+// Draws key numbers below n where key i comes up about 1 / (i + 1) as
+// often as key 0, the way a few hot keys get most of the traffic
+class Zipf {
+ public:
+  explicit Zipf(size_t n) : cdf(n) {
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+      total += 1.0 / static_cast<double>(i + 1);
+      cdf[i] = total;
+    }
+    for (auto& c : cdf) {
+      c /= total;
+    }
+  }
+
+  size_t next(mt19937_64& rng) {
+    double u = uniform_real_distribution<double>(0, 1)(rng);
+    return min<size_t>(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin(),
+                       cdf.size() - 1);
+  }
+
+ private:
+  vector<double> cdf;
+};
+
+// Memory held by a namespace of large values with and without tiering,
+// the latency of sget on a skewed workload where the cold values live on
+// disk, and what spilling costs a write next to many small keys
+void bench_tiering(size_t scale) {
+  const size_t keys = 2000 * scale;
+  const size_t reads = 20000 * scale;
+  const string value(16 * 1024, 'v');
+  for (bool tiered : {false, true}) {
+    const string how = tiered ? "tiered" : "in memory";
+    string log = "/tmp/simplekv_bench_" + to_string(getpid()) + ".log";
+    double heap_before = heap_bytes();
+    {
+      SimpleKV kv;
+      // keep a tenth of the data in memory
+      if (tiered && !kv.enable_tiering("n", log, keys * value.size() / 10)) {
+        fprintf(stderr, "couldn't create %s\n", log.c_str());
+        return;
+      }
+      for (size_t i = 0; i < keys; i++) {
+        kv.sset("n", "k" + to_string(i), value);
+      }
+      report(how + ", heap after loading", (heap_bytes() - heap_before) / 1e6,
+             "MB");
+      Zipf zipf(keys);
+      mt19937_64 rng(1);
+      vector<double> latencies;
+      latencies.reserve(reads);
+      for (size_t i = 0; i < reads; i++) {
+        string key = "k" + to_string(zipf.next(rng));
+        Timer timer;
+        kv.sget("n", key);
+        latencies.push_back(timer.seconds() * 1e6);
+      }
+      sort(latencies.begin(), latencies.end());
+      report(how + ", sget p50", latencies[reads / 2], "us");
+      report(how + ", sget p99", latencies[reads * 99 / 100], "us");
+      if (tiered) {
+        auto stats = kv.tier_stats("n");
+        report("tiered, faults per 1000 reads",
+               static_cast<double>(stats.faults) * 1000 / reads, "");
+      }
+    }
+  }
+  // a sweep only looks at the values it spills and the keys used since
+  // the last one, so small keys sitting in the namespace cost it nothing
+  for (size_t small : {size_t{0}, 200000 * scale}) {
+    string log = "/tmp/simplekv_bench_" + to_string(getpid()) + ".log";
+    SimpleKV kv;
+    if (!kv.enable_tiering("n", log, 100 * value.size())) {
+      fprintf(stderr, "couldn't create %s\n", log.c_str());
+      return;
+    }
+    for (size_t i = 0; i < small; i++) {
+      kv.sset("n", "small" + to_string(i), "v");
+    }
+    // the first sweep counts every key written so far, once
+    const size_t writes = 2000 * scale;
+    for (size_t i = 0; i < writes; i++) {
+      kv.sset("n", "warm" + to_string(i), value);
+    }
+    Timer timer;
+    for (size_t i = 0; i < writes; i++) {
+      kv.sset("n", "k" + to_string(i), value);
+    }
+    report_per_op("tiered, sset with " + to_string(small) + " small keys",
+                  timer, writes);
+  }
+}
+
+// What clone() costs, what the first write to a shared namespace costs,
+// and how much memory a clone holds once writes have reached a share of
+// its namespaces. The values are 100 bytes, so copying them would show.
+void bench_clone(size_t scale) {
+  const size_t namespaces = 100;
+  const size_t keys_per = 2000 * scale;
+  const string value(100, 'v');
+  SimpleKV kv;
+  for (size_t n = 0; n < namespaces; n++) {
+    for (size_t k = 0; k < keys_per; k++) {
+      kv.sset("n" + to_string(n), "k" + to_string(k), value);
+    }
+  }
+  {
+    const size_t rounds = 1000;
+    Timer timer;
+    for (size_t i = 0; i < rounds; i++) {
+      kv.clone();
+    }
+    report_per_op("clone of " + to_string(namespaces) + " namespaces", timer,
+                  rounds);
+  }
+  {
+    auto copy = kv.clone();
+    Timer first;
+    copy->sset("n0", "k0", "changed");
+    report("first write to a shared namespace", first.seconds() * 1e6, "us");
+    Timer second;
+    copy->sset("n0", "k1", "changed");
+    report("second write to it", second.seconds() * 1e6, "us");
+    Timer no_op;
+    copy->del("n1", "missing");
+    report("no-op del in a shared namespace", no_op.seconds() * 1e6, "us");
+  }
+  for (size_t percent : {0, 1, 10, 50, 100}) {
+    double heap_before = heap_bytes();
+    auto copy = kv.clone();
+    // one write in each of the first percent of namespaces
+    for (size_t n = 0; n < namespaces * percent / 100; n++) {
+      copy->sset("n" + to_string(n), "k0", "changed");
+    }
+    report("clone heap, " + to_string(percent) + "% of namespaces written",
+           (heap_bytes() - heap_before) / 1e6, "MB");
+  }
+}
+
+// The same operations on a hot key by name and through a handle, in a
+// namespace big enough that finding the key costs something, and the
+// saving per operation
+void bench_handles(size_t scale) {
+  const size_t ops = 2000 * scale;
+  const size_t keys = max<size_t>(20000, 2 * ops);
+  SimpleKV kv;
+  for (size_t i = 0; i < keys; i++) {
+    kv.sset("n", "k" + to_string(i), "value");
+  }
+  kv.sset("n", "hot", "value");
+  kv.rpush("n", "queue", "x");
+  auto hot = kv.handle("n", "hot");
+  auto queue = kv.handle("n", "queue");
+
+  struct Op {
+    const char* name;
+    function<void()> by_name;
+    function<void()> by_handle;
+  };
+  vector<Op> all = {
+      {"sget", [&] { kv.sget("n", "hot"); }, [&] { kv.sget(hot); }},
+      {"sset", [&] { kv.sset("n", "hot", "value"); },
+       [&] { kv.sset(hot, "value"); }},
+      {"llen", [&] { kv.llen("n", "queue"); }, [&] { kv.llen(queue); }},
+      {"rpush+lpop",
+       [&] {
+         kv.rpush("n", "queue", "x");
+         kv.lpop("n", "queue");
+       },
+       [&] {
+         kv.rpush(queue, "x");
+         kv.lpop(queue);
+       }},
+  };
+  for (const auto& op : all) {
+    Timer by_name;
+    for (size_t i = 0; i < ops; i++) {
+      op.by_name();
+    }
+    double name_ns = by_name.seconds() * 1e9 / static_cast<double>(ops);
+    Timer by_handle;
+    for (size_t i = 0; i < ops; i++) {
+      op.by_handle();
+    }
+    double handle_ns = by_handle.seconds() * 1e9 / static_cast<double>(ops);
+    report(string(op.name) + " by name", name_ns, "ns/op");
+    report(string(op.name) + " by handle", handle_ns, "ns/op");
+    report(string(op.name) + " saved per op", name_ns - handle_ns, "ns/op");
+  }
+  // the worst case for a handle, a delete elsewhere before every op makes
+  // it look the key up again
+  Timer stale_handle;
+  for (size_t i = 0; i < ops; i++) {
+    kv.del("n", "k" + to_string(i));
+    kv.sget(hot);
+  }
+  report_per_op("delete + sget by handle", stale_handle, ops);
+  Timer stale_name;
+  for (size_t i = ops; i < 2 * ops; i++) {
+    kv.del("n", "k" + to_string(i));
+    kv.sget("n", "hot");
+  }
+  report_per_op("delete + sget by name", stale_name, ops);
+}
+
+struct Benchmark {
+  const char* name;
+  function<void(size_t)> run;
+};
+
+const vector<Benchmark>& benchmarks() {
+  static const vector<Benchmark> all = {
+      {"cluster", bench_cluster},
+      {"blocking", bench_blocking},
+      {"compression", bench_compression},
+      {"interning", bench_interning},
+      {"typed", bench_typed},
+      {"bulk_load", bench_bulk_load},
+      {"query", bench_query},
+      {"index", bench_index},
+      {"tiering", bench_tiering},
+      {"clone", bench_clone},
+      {"handles", bench_handles},
+  };
+  return all;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  string only = argc > 1 ? argv[1] : "";
+  size_t scale = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+  if (scale == 0) {
+    scale = 1;
+  }
+  bool found = false;
+  for (const auto& benchmark : benchmarks()) {
+    if (!only.empty() && only != benchmark.name) {
+      continue;
+    }
+    found = true;
+    printf("%s\n", benchmark.name);
+    benchmark.run(scale);
+  }
+  if (!found) {
+    fprintf(stderr, "no benchmark named %s\n", only.c_str());
+    return 1;
+  }
+  return 0;
+}
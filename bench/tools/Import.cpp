@@ -0,0 +1,95 @@
+// Loads an export file into a SimpleKV with bulk_load and reports how long
+// it took.
+//
+// Build and run from the repository root:
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/tools/Import.cpp *.cpp -o import
+//   ./import data.tsv                lines format, one thread per core
+//   ./import data.bin binary 8       binary format, 8 threads
+//
+// Several files can be given, separated by commas; they are loaded one
+// after the other into the same store, so lists carry on across files.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+vector<string> split_paths(const string& arg) {
+  vector<string> res{};
+  stringstream in(arg);
+  string path;
+  while (getline(in, path, ',')) {
+    if (!path.empty()) {
+      res.push_back(path);
+    }
+  }
+  return res;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <file>[,<file>...] [lines|binary] [threads]\n",
+            argv[0]);
+    return 2;
+  }
+  string format_name = argc > 2 ? argv[2] : "lines";
+  if (format_name != "lines" && format_name != "binary") {
+    fprintf(stderr, "unknown format %s\n", format_name.c_str());
+    return 2;
+  }
+  auto format =
+      format_name == "lines" ? bulk_format::lines : bulk_format::binary;
+  size_t threads = argc > 3 ? strtoul(argv[3], nullptr, 10) : 0;
+  if (threads == 0) {
+    threads = max<size_t>(1, thread::hardware_concurrency());
+  }
+
+  SimpleKV kv;
+  size_t total_records = 0;
+  double total_seconds = 0;
+  for (const auto& path : split_paths(argv[1])) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+      fprintf(stderr, "can't open %s\n", path.c_str());
+      return 1;
+    }
+    auto start = chrono::steady_clock::now();
+    auto records = kv.bulk_load(in, format, threads);
+    double seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!records) {
+      fprintf(stderr, "%s is malformed, nothing was loaded from it\n",
+              path.c_str());
+      return 1;
+    }
+    printf("%-40s %12zu records %9.3f s %12.0f records/s\n", path.c_str(),
+           *records, seconds, *records / seconds);
+    total_records += *records;
+    total_seconds += seconds;
+  }
+
+  size_t keys = 0;
+  auto namespaces = kv.namespaces();
+  for (const auto& nspace : namespaces) {
+    keys += kv.keys(nspace).size();
+  }
+  printf("loaded %zu records into %zu keys in %zu namespaces, %zu threads, "
+         "%.3f s\n",
+         total_records, keys, namespaces.size(), threads, total_seconds);
+  return 0;
+}
@@ -0,0 +1,269 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./ChangeFeed.hpp"
+#include "./RingBuffer.hpp"
+#include "./SimpleKV.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+using chrono::milliseconds;
+using chrono::steady_clock;
+
+void test_blpop_times_out() {
+  SimpleKV kv;
+  auto start = steady_clock::now();
+  CHECK(!kv.blpop("n", "q", milliseconds(50)).has_value());
+  CHECK(steady_clock::now() - start >= milliseconds(50));
+  // a string fails right away instead of waiting
+  kv.sset("n", "s", "v");
+  start = steady_clock::now();
+  CHECK(!kv.brpop("n", "s", milliseconds(5000)).has_value());
+  CHECK(steady_clock::now() - start < milliseconds(1000));
+}
+
+void test_blpop_returns_existing_value() {
+  SimpleKV kv;
+  kv.rpush("n", "q", "a");
+  kv.rpush("n", "q", "b");
+  CHECK(kv.blpop("n", "q", milliseconds(0)) == "a");
+  CHECK(kv.brpop("n", "q", milliseconds(0)) == "b");
+  CHECK(!kv.key_exists("n", "q"));
+}
+
+void test_blpop_wakes_on_push() {
+  SimpleKV kv;
+  optional<string> got;
+  thread waiter([&] { got = kv.blpop("n", "q", milliseconds(5000)); });
+  this_thread::sleep_for(milliseconds(20));
+  auto start = steady_clock::now();
+  kv.lpush("n", "q", "v");
+  waiter.join();
+  CHECK(got == "v");
+  CHECK(steady_clock::now() - start < milliseconds(1000));
+}
+
+void test_waiters_served_in_order() {
+  SimpleKV kv;
+  mutex got_mtx;
+  vector<int> order;
+  vector<thread> waiters;
+  for (int i = 0; i < 3; i++) {
+    waiters.emplace_back([&, i] {
+      auto value = kv.blpop("n", "q", milliseconds(5000));
+      CHECK(value.has_value());
+      lock_guard<mutex> lock(got_mtx);
+      order.push_back(i);
+    });
+    // let each waiter get in line before the next one arrives
+    this_thread::sleep_for(milliseconds(30));
+  }
+  for (int i = 0; i < 3; i++) {
+    kv.rpush("n", "q", to_string(i));
+    this_thread::sleep_for(milliseconds(30));
+  }
+  for (auto& waiter : waiters) {
+    waiter.join();
+  }
+  CHECK((order == vector<int>{0, 1, 2}));
+}
+
+// Several producers and consumers share one queue. Every value has to be
+// handed out exactly once.
+void test_producers_and_consumers() {
+  SimpleKV kv;
+  const int producers = 4;
+  const int consumers = 4;
+  const int per_producer = 5000;
+  atomic<int> taken{0};
+  mutex seen_mtx;
+  multiset<string> seen;
+  vector<thread> threads;
+  for (int c = 0; c < consumers; c++) {
+    threads.emplace_back([&, c] {
+      while (taken.load() < producers * per_producer) {
+        auto value = c % 2 == 0 ? kv.blpop("n", "q", milliseconds(10))
+                                : kv.brpop("n", "q", milliseconds(10));
+        if (value) {
+          taken++;
+          lock_guard<mutex> lock(seen_mtx);
+          seen.insert(*value);
+        }
+      }
+    });
+  }
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < per_producer; i++) {
+        string value = to_string(p) + ":" + to_string(i);
+        if (i % 2 == 0) {
+          kv.rpush("n", "q", value);
+        } else {
+          kv.lpush("n", "q", value);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(seen.size() == static_cast<size_t>(producers * per_producer));
+  CHECK(set<string>(seen.begin(), seen.end()).size() == seen.size());
+  CHECK(!kv.key_exists("n", "q"));
+}
+
+void test_change_feed_events() {
+  SimpleKV kv;
+  auto sub = kv.subscribe("n", "job:");
+  kv.sset("n", "job:1", "a");
+  kv.sset("n", "other", "b");
+  kv.sset("m", "job:1", "c");
+  kv.rpush("n", "job:2", "x");
+  kv.lpush("n", "job:2", "y");
+  kv.lset("n", "job:2", 0, "z");
+  kv.lpop("n", "job:2");
+  kv.rpop("n", "job:2");
+  kv.del("n", "job:1");
+  // failed operations are not reported
+  kv.del("n", "job:missing");
+  kv.sset("n", "job:1", "s");
+  CHECK(!kv.lpush("n", "job:1", "nope"));
+
+  vector<change_type> types;
+  vector<string> values;
+  while (auto event = sub->poll()) {
+    CHECK(event->nspace == "n");
+    CHECK(event->key.compare(0, 4, "job:") == 0);
+    types.push_back(event->type);
+    values.push_back(event->value);
+  }
+  CHECK((types == vector<change_type>{
+                      change_type::set, change_type::rpush, change_type::lpush,
+                      change_type::lset, change_type::lpop, change_type::rpop,
+                      change_type::del, change_type::set}));
+  CHECK((values == vector<string>{"a", "x", "y", "z", "z", "x", "", "s"}));
+  CHECK(kv.unsubscribe(sub));
+  CHECK(!kv.unsubscribe(sub));
+  kv.sset("n", "job:1", "after");
+  CHECK(!sub->poll().has_value());
+}
+
+void test_change_feed_drops_when_full() {
+  SimpleKV kv;
+  auto sub = kv.subscribe("n", "", 4);
+  for (int i = 0; i < 10; i++) {
+    kv.sset("n", "k", to_string(i));
+  }
+  int delivered = 0;
+  while (sub->poll()) {
+    delivered++;
+  }
+  CHECK(delivered == 4);
+  CHECK(sub->dropped() == 6);
+}
+
+void test_change_feed_next_wakes() {
+  SimpleKV kv;
+  auto sub = kv.subscribe("n");
+  CHECK(!sub->next(milliseconds(20)).has_value());
+  thread writer([&] {
+    this_thread::sleep_for(milliseconds(20));
+    kv.sset("n", "k", "v");
+  });
+  auto event = sub->next(milliseconds(5000));
+  writer.join();
+  CHECK(event.has_value());
+  CHECK(event->value == "v");
+}
+
+// One writer thread and one reader thread on the same subscription, the
+// reader has to see every event that wasn't dropped, in order
+void test_change_feed_concurrent() {
+  SimpleKV kv;
+  auto sub = kv.subscribe("n", "", 64);
+  const int total = 50000;
+  atomic<bool> done{false};
+  vector<int> got;
+  thread reader([&] {
+    while (true) {
+      auto event = sub->next(milliseconds(10));
+      if (event) {
+        got.push_back(stoi(event->value));
+      } else if (done.load()) {
+        break;
+      }
+    }
+  });
+  for (int i = 0; i < total; i++) {
+    kv.sset("n", "k", to_string(i));
+  }
+  done = true;
+  reader.join();
+  CHECK(got.size() + sub->dropped() == static_cast<size_t>(total));
+  for (size_t i = 1; i < got.size(); i++) {
+    CHECK(got[i - 1] < got[i]);
+  }
+}
+
+void test_ring_buffer() {
+  RingBuffer<int> ring(3);
+  CHECK(ring.capacity() == 4);
+  CHECK(ring.empty());
+  for (int i = 0; i < 4; i++) {
+    CHECK(ring.try_push(i));
+  }
+  CHECK(!ring.try_push(4));
+  CHECK(ring.try_pop() == 0);
+  CHECK(ring.try_push(4));
+  for (int i = 1; i <= 4; i++) {
+    CHECK(ring.try_pop() == i);
+  }
+  CHECK(!ring.try_pop().has_value());
+
+  // a producer and a consumer thread hammering a small buffer
+  RingBuffer<int> shared(8);
+  const int total = 200000;
+  thread producer([&] {
+    for (int i = 0; i < total;) {
+      if (shared.try_push(i)) {
+        i++;
+      }
+    }
+  });
+  for (int expected = 0; expected < total;) {
+    auto value = shared.try_pop();
+    if (value) {
+      CHECK(*value == expected);
+      expected++;
+    }
+  }
+  producer.join();
+  CHECK(shared.empty());
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_blpop_times_out);
+  RUN(test_blpop_returns_existing_value);
+  RUN(test_blpop_wakes_on_push);
+  RUN(test_waiters_served_in_order);
+  RUN(test_producers_and_consumers);
+  RUN(test_change_feed_events);
+  RUN(test_change_feed_drops_when_full);
+  RUN(test_change_feed_next_wakes);
+  RUN(test_change_feed_concurrent);
+  RUN(test_ring_buffer);
+  return 0;
+}
@@ -0,0 +1,268 @@
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+string u32(uint32_t len) {
+  string res(4, '\0');
+  for (int i = 0; i < 4; i++) {
+    res[i] = static_cast<char>(len >> (8 * i));
+  }
+  return res;
+}
+
+string binary_record(char op, const string& nspace, const string& key,
+                     const string& value) {
+  return string(1, op) + u32(nspace.size()) + nspace + u32(key.size()) + key +
+         u32(value.size()) + value;
+}
+
+// Lines need their tabs, newlines and backslashes escaped
+string escape(const string& field) {
+  string res;
+  for (char c : field) {
+    if (c == '\t') {
+      res += "\\t";
+    } else if (c == '\n') {
+      res += "\\n";
+    } else if (c == '\\') {
+      res += "\\\\";
+    } else {
+      res += c;
+    }
+  }
+  return res;
+}
+
+string line_record(char op, const string& nspace, const string& key,
+                   const string& value) {
+  return string(1, op) + "\t" + escape(nspace) + "\t" + escape(key) + "\t" +
+         escape(value) + "\n";
+}
+
+void test_lines() {
+  SimpleKV kv;
+  stringstream in;
+  in << "S\tn\tname\tada\n"
+     << "\n"
+     << "R\tn\tlist\ta\n"
+     << "R\tn\tlist\tb\n"
+     << "S\tm\tesc\tone\\ttwo\\nthree\\\\\n";
+  CHECK(kv.bulk_load(in, bulk_format::lines) == size_t{4});
+  CHECK(kv.sget("n", "name") == "ada");
+  CHECK(kv.lmembers("n", "list") == vector<string>({"a", "b"}));
+  CHECK(kv.sget("m", "esc") == "one\ttwo\nthree\\");
+}
+
+void test_binary() {
+  SimpleKV kv;
+  string input = binary_record('S', "n", "k", string("with\0nul", 8)) +
+                 binary_record('R', "n", "list", "") +
+                 binary_record('R', "n", "list", "x");
+  stringstream in(input);
+  CHECK(kv.bulk_load(in, bulk_format::binary) == size_t{3});
+  CHECK(kv.sget("n", "k") == string("with\0nul", 8));
+  CHECK(kv.lmembers("n", "list") == vector<string>({"", "x"}));
+}
+
+void test_malformed_loads_nothing() {
+  vector<pair<string, bulk_format>> inputs = {
+      {"S\tn\tk\n", bulk_format::lines},
+      {"X\tn\tk\tv\n", bulk_format::lines},
+      {"S\tn\tk\tbad\\q\n", bulk_format::lines},
+      {"S\tn\tk\tv\textra\n", bulk_format::lines},
+      {binary_record('S', "n", "k", "v").substr(0, 10), bulk_format::binary},
+      {binary_record('Q', "n", "k", "v"), bulk_format::binary},
+  };
+  // a malformed record far from the start fails too, after the workers
+  // have already built the earlier chunks
+  string late;
+  for (int i = 0; i < 100000; i++) {
+    late += "S\tn\tk" + to_string(i) + "\tvalue\n";
+  }
+  inputs.emplace_back(late + "oops\n", bulk_format::lines);
+  for (const auto& input : inputs) {
+    SimpleKV kv;
+    kv.sset("n", "k", "kept");
+    stringstream in(input.first);
+    CHECK(!kv.bulk_load(in, input.second, 4).has_value());
+    CHECK(kv.sget("n", "k") == "kept");
+    CHECK(kv.keys("n").size() == 1);
+  }
+}
+
+// A 13 byte record that claims a 4 GB value must fail on the missing bytes
+// rather than try to allocate them
+void test_huge_length() {
+  for (uint32_t len : {0xffffffffu, 0x7fffffffu, 5000000u}) {
+    SimpleKV kv;
+    string input = binary_record('S', "n", "k", "v");
+    input += string(1, 'S') + u32(1) + "n" + u32(1) + "k" + u32(len);
+    stringstream in(input);
+    CHECK(!kv.bulk_load(in, bulk_format::binary, 2).has_value());
+    CHECK(!kv.ns_exists("n"));
+  }
+  // same for a length in the namespace field of the very first record
+  SimpleKV kv;
+  stringstream in(string(1, 'S') + u32(0xfffffff0u));
+  CHECK(!kv.bulk_load(in, bulk_format::binary).has_value());
+}
+
+void test_lands_on_existing() {
+  SimpleKV kv;
+  kv.sset("n", "s", "old");
+  kv.rpush("n", "l", "old");
+  kv.rpush("n", "replaced", "old");
+  kv.sset("n", "untouched", "yes");
+  stringstream in("R\tn\ts\tnew\nR\tn\tl\tnew\nS\tn\treplaced\tnew\n");
+  CHECK(kv.bulk_load(in, bulk_format::lines) == size_t{3});
+  // the records act like the sset and rpush calls they stand for
+  CHECK(kv.sget("n", "s") == "old");
+  CHECK(kv.lmembers("n", "l") == vector<string>({"old", "new"}));
+  CHECK(kv.sget("n", "replaced") == "new");
+  CHECK(kv.sget("n", "untouched") == "yes");
+}
+
+// Loading two files one after the other gives the same lists as loading
+// both at once, including onto compressed, interned and spilled lists
+void test_two_loads_append() {
+  string first;
+  string second;
+  for (int i = 0; i < 2000; i++) {
+    first += "R\tn\tk" + to_string(i % 50) + "\tfirst-" + to_string(i) + "\n";
+    second += "R\tn\tk" + to_string(i % 70) + "\tsecond-" + to_string(i) + "\n";
+  }
+  for (int setting = 0; setting < 4; setting++) {
+    SimpleKV once;
+    SimpleKV twice;
+    for (SimpleKV* kv : {&once, &twice}) {
+      if (setting == 1) {
+        kv->enable_compression("n", 64);
+      } else if (setting == 2) {
+        kv->enable_interning("n");
+      } else if (setting == 3) {
+        string name = kv == &once ? "load_once.log" : "load_twice.log";
+        CHECK(kv->enable_tiering("n", testing::temp_path(name), 2000, 100));
+      }
+    }
+    stringstream both(first + second);
+    CHECK(once.bulk_load(both, bulk_format::lines, 3) == size_t{4000});
+    stringstream in_first(first);
+    stringstream in_second(second);
+    CHECK(twice.bulk_load(in_first, bulk_format::lines, 3) == size_t{2000});
+    CHECK(twice.bulk_load(in_second, bulk_format::lines, 2) == size_t{2000});
+    CHECK(twice.keys("n").size() == 70);
+    if (setting == 3) {
+      CHECK(twice.tier_stats("n").spills > 0);
+    }
+    for (const auto& key : once.keys("n")) {
+      CHECK(twice.lmembers("n", key) == once.lmembers("n", key));
+    }
+  }
+}
+
+// Any number of threads builds the same thing as pushing the records in
+// order, across many chunks and with keys repeated all over the input
+void test_matches_pushes() {
+  mt19937 rng(3);
+  SimpleKV pushed;
+  string lines;
+  string binary;
+  for (int i = 0; i < 200000; i++) {
+    string nspace = "n" + to_string(rng() % 3);
+    string key = "k" + to_string(rng() % 5000);
+    string value(rng() % 20, 'a' + static_cast<char>(rng() % 26));
+    if (rng() % 7 == 0) {
+      value += "\t\\\n";
+    }
+    char op = rng() % 5 == 0 ? 'S' : 'R';
+    if (op == 'S') {
+      pushed.sset(nspace, key, value);
+    } else {
+      pushed.rpush(nspace, key, value);
+    }
+    lines += line_record(op, nspace, key, value);
+    binary += binary_record(op, nspace, key, value);
+  }
+  for (size_t threads : {1, 2, 3, 8}) {
+    for (auto format : {bulk_format::lines, bulk_format::binary}) {
+      SimpleKV loaded;
+      stringstream in(format == bulk_format::lines ? lines : binary);
+      CHECK(loaded.bulk_load(in, format, threads) == size_t{200000});
+      CHECK(loaded.namespaces().size() == pushed.namespaces().size());
+      for (const auto& nspace : pushed.namespaces()) {
+        CHECK(loaded.keys(nspace).size() == pushed.keys(nspace).size());
+        for (const auto& key : pushed.keys(nspace)) {
+          CHECK(loaded.sget(nspace, key) == pushed.sget(nspace, key));
+          CHECK(loaded.lmembers(nspace, key) == pushed.lmembers(nspace, key));
+        }
+      }
+    }
+  }
+}
+
+void test_wakes_blpop() {
+  SimpleKV kv;
+  optional<string> got;
+  thread consumer([&] { got = kv.blpop("n", "q", chrono::seconds(10)); });
+  this_thread::sleep_for(chrono::milliseconds(50));
+  stringstream in("R\tn\tq\tjob\n");
+  CHECK(kv.bulk_load(in, bulk_format::lines) == size_t{1});
+  consumer.join();
+  CHECK(got == "job");
+}
+
+// Loads running at the same time as readers and writers on other threads
+void test_concurrent_loads() {
+  SimpleKV kv;
+  vector<thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      for (int round = 0; round < 20; round++) {
+        string input;
+        for (int i = 0; i < 500; i++) {
+          input += "R\tn" + to_string(t) + "\tk" + to_string(i) + "\tv\n";
+        }
+        stringstream in(input);
+        CHECK(kv.bulk_load(in, bulk_format::lines, 2) == size_t{500});
+        kv.rpush("n" + to_string(t), "pushed", "x");
+        kv.sget("n" + to_string((t + 1) % 4), "k1");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // every load pushes onto the lists of the loads before it
+  for (int t = 0; t < 4; t++) {
+    CHECK(kv.llen("n" + to_string(t), "k0") == size_t{20});
+    CHECK(kv.llen("n" + to_string(t), "pushed") == size_t{20});
+  }
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_lines);
+  RUN(test_binary);
+  RUN(test_malformed_loads_nothing);
+  RUN(test_huge_length);
+  RUN(test_lands_on_existing);
+  RUN(test_two_loads_append);
+  RUN(test_matches_pushes);
+  RUN(test_wakes_blpop);
+  RUN(test_concurrent_loads);
+  return 0;
+}
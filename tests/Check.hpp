@@ -0,0 +1,41 @@
+#ifndef TESTS_CHECK_HPP_
+#define TESTS_CHECK_HPP_
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// The tests are plain programs, one per feature, that stop at the first
+// check that fails. tests/run.sh builds and runs all of them.
+
+// Stops the test with the failing condition and where it is
+#define CHECK(cond)                                                    \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,      \
+                   __LINE__, #cond);                                   \
+      std::abort();                                                    \
+    }                                                                  \
+  } while (0)
+
+// Runs one test case and reports it
+#define RUN(test)                              \
+  do {                                         \
+    test();                                    \
+    std::printf("  %s ok\n", #test);           \
+  } while (0)
+
+namespace simplekv {
+namespace testing {
+
+// A scratch file path that is unique to this process, for tests that need
+// to write to disk
+inline std::string temp_path(const std::string& name) {
+  return "/tmp/simplekv_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+}  // namespace testing
+}  // namespace simplekv
+
+#endif  // TESTS_CHECK_HPP_
@@ -0,0 +1,287 @@
+#include <malloc.h>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+size_t heap_bytes() {
+  return mallinfo2().uordblks;
+}
+
+void test_isolation() {
+  SimpleKV kv;
+  kv.sset("n", "s", "original");
+  kv.rpush("n", "l", "a");
+  kv.sset("other", "k", "v");
+  auto copy = kv.clone();
+  copy->sset("n", "s", "changed");
+  copy->rpush("n", "l", "b");
+  copy->del("other", "k");
+  kv.lpush("n", "l", "z");
+  CHECK(kv.sget("n", "s") == "original");
+  CHECK(kv.lmembers("n", "l") == vector<string>({"z", "a"}));
+  CHECK(kv.sget("other", "k") == "v");
+  CHECK(copy->sget("n", "s") == "changed");
+  CHECK(copy->lmembers("n", "l") == vector<string>({"a", "b"}));
+  CHECK(!copy->ns_exists("other"));
+
+  auto only = kv.clone_namespace("n");
+  CHECK(only->namespaces() == vector<string>({"n"}));
+  CHECK(kv.clone_namespace("missing")->namespaces().empty());
+}
+
+// Writes that change nothing must leave a shared namespace shared. A copy
+// of this namespace takes megabytes, so the heap shows whether one was
+// made. (Sanitizer allocators don't show up in mallinfo2, everything
+// reads 0 under them and the check passes vacuously.)
+void test_no_op_writes_dont_copy() {
+  SimpleKV kv;
+  for (int i = 0; i < 100000; i++) {
+    kv.sset("n", "k" + to_string(i), "value");
+  }
+  kv.rpush("n", "list", "a");
+  auto copy = kv.clone();
+  size_t before = heap_bytes();
+  for (auto* store : {&kv, copy.get()}) {
+    CHECK(!store->del("n", "missing"));
+    CHECK(!store->lpop("n", "missing").has_value());
+    CHECK(!store->rpop("n", "k1").has_value());
+    CHECK(!store->lset("n", "list", 5, "x"));
+    CHECK(!store->lset("n", "k1", 0, "x"));
+    CHECK(!store->lpush("n", "k1", "x"));
+    CHECK(!store->rpush("n", "k1", "x"));
+  }
+  size_t no_ops = heap_bytes();
+  // a real write still copies, and only on the side that made it
+  CHECK(copy->del("n", "k1"));
+  size_t after = heap_bytes();
+  size_t grew = no_ops > before ? no_ops - before : 0;
+  size_t copied = after > no_ops ? after - no_ops : 0;
+  CHECK(grew * 10 <= copied);
+  CHECK(kv.sget("n", "k1") == "value");
+  CHECK(!copy->sget("n", "k1").has_value());
+}
+
+// The first write to a shared namespace copies its table of keys and the
+// one value it changes, not the other values
+void test_writes_copy_one_value() {
+  SimpleKV kv;
+  for (int i = 0; i < 1000; i++) {
+    kv.sset("n", "k" + to_string(i), string(10000, 'a'));
+  }
+  kv.rpush("n", "list", string(10000, 'b'));
+  auto copy = kv.clone();
+  size_t before = heap_bytes();
+  copy->sset("n", "k0", "changed");
+  copy->rpush("n", "list", "c");
+  size_t after = heap_bytes();
+  // the values add up to 10 MB, the table of keys to well under 1 MB
+  CHECK(after < before + 1000000);
+  CHECK(kv.sget("n", "k0") == string(10000, 'a'));
+  CHECK(kv.llen("n", "list") == 1);
+  CHECK(copy->sget("n", "k1") == string(10000, 'a'));
+  CHECK(copy->llen("n", "list") == 2);
+}
+
+// Compressed, interned and handle-reached values are shared the same way,
+// and a write on either side leaves the other side's value alone
+void test_shared_encoded_values() {
+  SimpleKV kv;
+  kv.enable_compression("z", 100);
+  kv.enable_interning("i");
+  kv.sset("z", "s", string(5000, 'x'));
+  for (int i = 0; i < 100; i++) {
+    kv.rpush("z", "l", string(50, 'y'));
+    kv.rpush("i", "l", "e" + to_string(i % 10));
+  }
+  kv.sset("i", "s", "interned");
+  kv.rpush("h", "l", "a");
+  kv.rpush("h", "l", "b");
+  kv.rpush("h", "l", "c");
+  CHECK(kv.compression_stats("z").compressed_values == 2);
+  auto handle = kv.handle("h", "l");
+  // let the handle settle on the value before it is shared
+  CHECK(kv.rpop(handle) == "c");
+  auto copy = kv.clone();
+
+  CHECK(copy->lset("z", "l", 0, "first"));
+  copy->rpush("i", "l", "last");
+  copy->sset("i", "s", "other");
+  CHECK(kv.rpop(handle) == "b");
+  kv.rpush(handle, "d");
+  CHECK(kv.lindex("z", "l", 0) == string(50, 'y'));
+  CHECK(copy->lindex("z", "l", 0) == "first");
+  CHECK(kv.llen("i", "l") == 100);
+  CHECK(copy->llen("i", "l") == 101);
+  CHECK(kv.sget("i", "s") == "interned");
+  CHECK(copy->sget("i", "s") == "other");
+  CHECK(kv.lmembers("h", "l") == vector<string>({"a", "d"}));
+  CHECK(copy->lmembers("h", "l") == vector<string>({"a", "b"}));
+  CHECK(copy->sget("z", "s") == string(5000, 'x'));
+
+  // dropping the original leaves the copy's values intact
+  kv.sset("z", "s", "gone");
+  CHECK(kv.del("i", "l"));
+  CHECK(copy->sget("z", "s") == string(5000, 'x'));
+  CHECK(copy->lindex("i", "l", 100) == "last");
+}
+
+// Each write that does change something lands on the right side, however
+// the keys were found before the copy was made
+void test_matches_copies() {
+  mt19937 rng(9);
+  SimpleKV kv;
+  SimpleKV expected_kv;
+  unique_ptr<SimpleKV> copy;
+  unique_ptr<SimpleKV> expected_copy;
+  auto apply = [&](SimpleKV& a, SimpleKV& b, const string& key,
+                   const string& value, size_t index, int op) {
+    switch (op) {
+      case 0:
+        a.sset("n", key, value);
+        b.sset("n", key, value);
+        break;
+      case 1:
+        CHECK(a.rpush("n", key, value) == b.rpush("n", key, value));
+        break;
+      case 2:
+        CHECK(a.lpush("n", key, value) == b.lpush("n", key, value));
+        break;
+      case 3:
+        CHECK(a.lpop("n", key) == b.lpop("n", key));
+        break;
+      case 4:
+        CHECK(a.rpop("n", key) == b.rpop("n", key));
+        break;
+      case 5:
+        CHECK(a.lset("n", key, index, value) == b.lset("n", key, index, value));
+        break;
+      default:
+        CHECK(a.del("n", key) == b.del("n", key));
+        break;
+    }
+  };
+  for (int step = 0; step < 40000; step++) {
+    // clone every so often, so writes keep finding shared namespaces
+    if (step % 200 == 0) {
+      copy = kv.clone();
+      expected_copy = make_unique<SimpleKV>();
+      for (const auto& key : expected_kv.keys("n")) {
+        if (auto list = expected_kv.lmembers("n", key)) {
+          for (const auto& elem : *list) {
+            expected_copy->rpush("n", key, elem);
+          }
+        } else {
+          expected_copy->sset("n", key, *expected_kv.sget("n", key));
+        }
+      }
+    }
+    string key = "k" + to_string(rng() % 20);
+    string value = "v" + to_string(rng() % 10);
+    size_t index = rng() % 4;
+    int op = static_cast<int>(rng() % 7);
+    if (rng() % 2 == 0) {
+      apply(kv, expected_kv, key, value, index, op);
+    } else {
+      apply(*copy, *expected_copy, key, value, index, op);
+    }
+    CHECK(kv.sget("n", key) == expected_kv.sget("n", key));
+    CHECK(kv.lmembers("n", key) == expected_kv.lmembers("n", key));
+    CHECK(copy->sget("n", key) == expected_copy->sget("n", key));
+    CHECK(copy->lmembers("n", key) == expected_copy->lmembers("n", key));
+  }
+}
+
+void test_settings_carry_over() {
+  SimpleKV kv;
+  kv.enable_compression("n", 100);
+  kv.enable_interning("i");
+  kv.enable_value_index("n");
+  auto copy = kv.clone();
+  copy->sset("n", "big", string(5000, 'x'));
+  CHECK(copy->compression_stats("n").compressed_values == 1);
+  CHECK(kv.compression_stats("n").compressed_values == 0);
+  copy->sset("i", "k", "shared");
+  CHECK(copy->interned_strings() == 1);
+  CHECK(copy->find_by_value("n", string(5000, 'x')) ==
+        vector<string>({"big"}));
+  CHECK(kv.find_by_value("n", string(5000, 'x')).empty());
+}
+
+// Clones of a tiered namespace read the spilled values through the same
+// log, and a no-op write leaves the spilled records alone
+void test_tiered() {
+  auto log = testing::temp_path("clone_tier.log");
+  SimpleKV kv;
+  CHECK(kv.enable_tiering("n", log, 0, 100));
+  kv.sset("n", "big", string(5000, 'b'));
+  kv.sset("n", "small", "s");
+  CHECK(kv.tier_stats("n").spilled_values == 1);
+  auto copy = kv.clone();
+  CHECK(!copy->del("n", "missing"));
+  CHECK(copy->sget("n", "big") == string(5000, 'b'));
+  copy->sset("n", "big", "replaced");
+  CHECK(kv.sget("n", "big") == string(5000, 'b'));
+  CHECK(copy->sget("n", "big") == "replaced");
+  // values spilled while shared stay readable on both sides once one side
+  // reads them back or drops them
+  kv.sset("n", "a", string(5000, 'a'));
+  kv.sset("n", "c", string(5000, 'c'));
+  auto second = kv.clone();
+  CHECK(second->sget("n", "a") == string(5000, 'a'));
+  CHECK(second->del("n", "c"));
+  CHECK(kv.sget("n", "c") == string(5000, 'c'));
+  second.reset();
+  CHECK(kv.sget("n", "a") == string(5000, 'a'));
+  CHECK(kv.disable_tiering("n"));
+  CHECK(copy->disable_tiering("n"));
+  CHECK(kv.sget("n", "c") == string(5000, 'c'));
+}
+
+// Clones made and written while other threads write the original
+void test_concurrent() {
+  SimpleKV kv;
+  atomic<bool> stop{false};
+  thread writer([&] {
+    mt19937 rng(2);
+    while (!stop.load()) {
+      string key = "k" + to_string(rng() % 100);
+      kv.rpush("n", key, "x");
+      kv.lpop("n", key);
+      kv.sset("m", key, "y");
+    }
+  });
+  for (int i = 0; i < 2000; i++) {
+    auto copy = kv.clone();
+    auto keys = copy->keys("m");
+    copy->del("m", "k1");
+    copy->lpop("n", "k2");
+    CHECK(copy->keys("m").size() + 1 >= keys.size());
+  }
+  stop = true;
+  writer.join();
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_isolation);
+  RUN(test_no_op_writes_dont_copy);
+  RUN(test_writes_copy_one_value);
+  RUN(test_shared_encoded_values);
+  RUN(test_matches_copies);
+  RUN(test_settings_carry_over);
+  RUN(test_tiered);
+  RUN(test_concurrent);
+  return 0;
+}
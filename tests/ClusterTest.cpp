@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./KVCluster.hpp"
+#include "./KVNode.hpp"
+#include "./SimpleKV.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+// A local node that counts how many lists it hands out
+class CountingNode : public LocalNode {
+ public:
+  CountingNode(SimpleKV* store, int* fetches)
+      : LocalNode(store), fetches(fetches) {}
+
+  optional<vector<string>> lmembers(const string& nspace,
+                                    const string& key) override {
+    (*fetches)++;
+    return LocalNode::lmembers(nspace, key);
+  }
+
+ private:
+  int* fetches;
+};
+
+optional<vector<string>> sorted(optional<vector<string>> list) {
+  if (list) {
+    sort(list->begin(), list->end());
+  }
+  return list;
+}
+
+// Checks that every key of the reference is in the cluster and lives on
+// exactly the store that owns it
+void check_placement(KVCluster& cluster,
+                     SimpleKV& reference,
+                     map<string, SimpleKV*>& stores) {
+  for (const auto& nspace : reference.namespaces()) {
+    for (const auto& key : reference.keys(nspace)) {
+      auto owner = cluster.node_for(nspace, key);
+      CHECK(owner.has_value());
+      for (auto& pair : stores) {
+        CHECK(pair.second->key_exists(nspace, key) == (pair.first == *owner));
+      }
+      CHECK(cluster.sget(nspace, key) == reference.sget(nspace, key));
+      CHECK(cluster.lmembers(nspace, key) == reference.lmembers(nspace, key));
+    }
+    auto keys = cluster.keys(nspace);
+    CHECK(keys.size() == reference.keys(nspace).size());
+  }
+}
+
+void test_membership() {
+  SimpleKV a;
+  KVCluster cluster(16);
+  CHECK(!cluster.node_for("n", "k").has_value());
+  cluster.sset("n", "k", "dropped");
+  CHECK(!cluster.key_exists("n", "k"));
+  CHECK(cluster.add_node("a", &a));
+  CHECK(!cluster.add_node("a", &a));
+  CHECK(!cluster.add_node("b", static_cast<SimpleKV*>(nullptr)));
+  CHECK(!cluster.add_node("b", unique_ptr<KVNode>()));
+  CHECK(cluster.nodes() == vector<string>{"a"});
+  cluster.sset("n", "k", "v");
+  // removing the last node leaves its keys where they are
+  CHECK(cluster.remove_node("a"));
+  CHECK(!cluster.remove_node("a"));
+  CHECK(a.sget("n", "k") == "v");
+}
+
+void test_matches_single_store() {
+  mt19937 rng(7);
+  SimpleKV reference;
+  map<string, SimpleKV> owned;
+  map<string, SimpleKV*> stores;
+  KVCluster cluster(32);
+  for (string name : {"a", "b", "c"}) {
+    stores[name] = &owned[name];
+    CHECK(cluster.add_node(name, stores[name]));
+  }
+  for (int step = 0; step < 20000; step++) {
+    string nspace = "n" + to_string(rng() % 3);
+    string key = "k" + to_string(rng() % 200);
+    string value = "v" + to_string(rng() % 20);
+    switch (rng() % 8) {
+      case 0:
+        cluster.sset(nspace, key, value);
+        reference.sset(nspace, key, value);
+        break;
+      case 1:
+        CHECK(cluster.del(nspace, key) == reference.del(nspace, key));
+        break;
+      case 2:
+        CHECK(cluster.lpush(nspace, key, value) ==
+              reference.lpush(nspace, key, value));
+        break;
+      case 3:
+        CHECK(cluster.rpush(nspace, key, value) ==
+              reference.rpush(nspace, key, value));
+        break;
+      case 4:
+        CHECK(cluster.lpop(nspace, key) == reference.lpop(nspace, key));
+        break;
+      case 5: {
+        size_t index = rng() % 3;
+        CHECK(cluster.lset(nspace, key, index, value) ==
+              reference.lset(nspace, key, index, value));
+        break;
+      }
+      case 6: {
+        string key2 = "k" + to_string(rng() % 200);
+        CHECK(sorted(cluster.lunion(nspace, key, nspace, key2)) ==
+              sorted(reference.lunion(nspace, key, nspace, key2)));
+        CHECK(sorted(cluster.linter(nspace, key, nspace, key2)) ==
+              sorted(reference.linter(nspace, key, nspace, key2)));
+        CHECK(sorted(cluster.ldiff(nspace, key, nspace, key2)) ==
+              sorted(reference.ldiff(nspace, key, nspace, key2)));
+        break;
+      }
+      default:
+        CHECK(cluster.type(nspace, key) == reference.type(nspace, key));
+        CHECK(cluster.llen(nspace, key) == reference.llen(nspace, key));
+        CHECK(cluster.lindex(nspace, key, 0) ==
+              reference.lindex(nspace, key, 0));
+        break;
+    }
+    // membership changes in the middle of the workload
+    if (step == 5000) {
+      stores["d"] = &owned["d"];
+      CHECK(cluster.add_node("d", stores["d"]));
+      check_placement(cluster, reference, stores);
+    } else if (step == 12000) {
+      CHECK(cluster.remove_node("b"));
+      stores.erase("b");
+      CHECK(owned["b"].namespaces().empty());
+      check_placement(cluster, reference, stores);
+    }
+  }
+  check_placement(cluster, reference, stores);
+}
+
+void test_rebalance_moves_few_keys() {
+  SimpleKV a, b, c, d;
+  KVCluster cluster(128);
+  cluster.add_node("a", &a);
+  cluster.add_node("b", &b);
+  cluster.add_node("c", &c);
+  const int total = 6000;
+  for (int i = 0; i < total; i++) {
+    cluster.sset("n", "k" + to_string(i), "v");
+  }
+  // every key that doesn't belong to the new node stays where it was
+  map<string, string> before;
+  for (int i = 0; i < total; i++) {
+    before["k" + to_string(i)] = *cluster.node_for("n", "k" + to_string(i));
+  }
+  cluster.add_node("d", &d);
+  int moved = 0;
+  for (const auto& pair : before) {
+    auto now = *cluster.node_for("n", pair.first);
+    if (now != pair.second) {
+      CHECK(now == "d");
+      moved++;
+    }
+  }
+  CHECK(static_cast<size_t>(moved) == d.keys("n").size());
+  // the new node takes about a quarter of the keys
+  CHECK(moved > total / 8 && moved < total / 2);
+}
+
+void test_cross_node_fetches() {
+  SimpleKV a, b;
+  int fetches = 0;
+  KVCluster cluster(64);
+  cluster.add_node("a", make_unique<CountingNode>(&a, &fetches));
+  cluster.add_node("b", make_unique<CountingNode>(&b, &fetches));
+  // find two keys that live on different nodes
+  string key1 = "k0";
+  string key2;
+  for (int i = 1; key2.empty(); i++) {
+    string key = "k" + to_string(i);
+    if (cluster.node_for("n", key) != cluster.node_for("n", key1)) {
+      key2 = key;
+    }
+  }
+  cluster.rpush("n", key2, "x");
+  // the first list is missing, so the second one never has to be fetched
+  fetches = 0;
+  CHECK(cluster.ldiff("n", key1, "n", key2) == vector<string>{});
+  CHECK(fetches == 1);
+  cluster.rpush("n", key1, "x");
+  cluster.rpush("n", key1, "y");
+  fetches = 0;
+  CHECK(cluster.ldiff("n", key1, "n", key2) == vector<string>{"y"});
+  CHECK(fetches == 2);
+  // a string on either side fails before anything is fetched
+  cluster.sset("n", key2, "s");
+  fetches = 0;
+  CHECK(!cluster.linter("n", key1, "n", key2).has_value());
+  CHECK(fetches == 0);
+}
+
+// Writers keep using their keys while nodes join and leave. A write that
+// races a move has to end up where the key moves to, not on the node it
+// just left.
+void test_live_rebalance() {
+  map<string, SimpleKV> owned;
+  for (string name : {"a", "b", "c", "d"}) {
+    owned[name];
+  }
+  KVCluster cluster(32);
+  CHECK(cluster.add_node("a", &owned["a"]));
+  CHECK(cluster.add_node("b", &owned["b"]));
+  const int writers = 3;
+  const int keys = 40;
+  atomic<bool> stop{false};
+  // each writer owns its keys, so it knows what they hold
+  vector<vector<size_t>> pushed(writers, vector<size_t>(keys, 0));
+  vector<thread> threads;
+  for (int t = 0; t < writers; t++) {
+    threads.emplace_back([&, t] {
+      mt19937 rng(t);
+      while (!stop.load()) {
+        size_t k = rng() % keys;
+        string key = "t" + to_string(t) + "_" + to_string(k);
+        size_t n = pushed[t][k]++;
+        CHECK(cluster.rpush("lists", key, to_string(n)));
+        auto list = cluster.lmembers("lists", key);
+        CHECK(list && list->size() == n + 1 && list->back() == to_string(n));
+        cluster.sset("strings", key, to_string(n));
+        CHECK(cluster.sget("strings", key) == to_string(n));
+      }
+    });
+  }
+  this_thread::sleep_for(chrono::milliseconds(20));
+  for (int round = 0; round < 3; round++) {
+    CHECK(cluster.add_node("c", &owned["c"]));
+    CHECK(cluster.add_node("d", &owned["d"]));
+    CHECK(cluster.remove_node("a"));
+    CHECK(cluster.remove_node("c"));
+    CHECK(cluster.add_node("a", &owned["a"]));
+    CHECK(cluster.remove_node("d"));
+    this_thread::sleep_for(chrono::milliseconds(5));
+  }
+  stop = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // every push is there, in order, on the one node that owns the key
+  for (int t = 0; t < writers; t++) {
+    for (int k = 0; k < keys; k++) {
+      string key = "t" + to_string(t) + "_" + to_string(k);
+      auto list = cluster.lmembers("lists", key).value_or(vector<string>{});
+      CHECK(list.size() == pushed[t][k]);
+      for (size_t i = 0; i < list.size(); i++) {
+        CHECK(list[i] == to_string(i));
+      }
+      for (auto& pair : owned) {
+        CHECK(pair.second.key_exists("lists", key) ==
+              (pushed[t][k] > 0 &&
+               pair.first == *cluster.node_for("lists", key)));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_membership);
+  RUN(test_matches_single_store);
+  RUN(test_rebalance_moves_few_keys);
+  RUN(test_cross_node_fetches);
+  RUN(test_live_rebalance);
+  return 0;
+}
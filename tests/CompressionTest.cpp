@@ -0,0 +1,239 @@
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./Compression.hpp"
+#include "./SimpleKV.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+// Text that compresses well, like the JSON blobs compression is meant for
+string json_blob(size_t bytes, int seed) {
+  string res = "{";
+  for (int i = 0; res.size() < bytes; i++) {
+    res += "\"field" + to_string(i % 50) + "\": \"value-" +
+           to_string((seed + i) % 7) + "\", ";
+  }
+  res.resize(bytes);
+  return res;
+}
+
+size_t compressed_values(SimpleKV& kv, const string& nspace) {
+  return kv.compression_stats(nspace).compressed_values;
+}
+
+void test_codec_round_trip() {
+  mt19937 rng(1);
+  vector<string> inputs = {"", "a", "abcd", string(100000, 'x'),
+                           json_blob(50000, 3)};
+  string noise(5000, '\0');
+  for (auto& c : noise) {
+    c = static_cast<char>(rng());
+  }
+  inputs.push_back(noise);
+  for (const auto& input : inputs) {
+    auto packed = compress_block(input);
+    CHECK(decompress_block(packed, input.size()) == input);
+  }
+  CHECK(compress_block(string(100000, 'x')).size() < 1000);
+  // a malformed block is cut short instead of overrunning
+  auto packed = compress_block(json_blob(1000, 1));
+  packed.resize(packed.size() / 2);
+  CHECK(decompress_block(packed, 1000).size() <= 1000);
+}
+
+void test_strings() {
+  SimpleKV kv;
+  kv.enable_compression("n", 1000);
+  auto big = json_blob(100000, 1);
+  kv.sset("n", "big", big);
+  kv.sset("n", "small", "tiny");
+  CHECK(kv.sget("n", "big") == big);
+  CHECK(kv.sget("n", "small") == "tiny");
+  auto stats = kv.compression_stats("n");
+  CHECK(stats.values == 2);
+  CHECK(stats.compressed_values == 1);
+  CHECK(stats.raw_bytes == big.size());
+  CHECK(stats.ratio() > 2);
+  // turning it off leaves the stored value compressed, new ones aren't
+  kv.disable_compression("n");
+  kv.sset("n", "big2", big);
+  CHECK(compressed_values(kv, "n") == 1);
+  CHECK(kv.sget("n", "big") == big);
+}
+
+// A short list of large elements never fills a chunk, it has to be caught
+// by its size alone
+void test_short_list_of_large_elements() {
+  SimpleKV kv;
+  kv.enable_compression("n");
+  vector<string> expected;
+  for (int i = 0; i < 10; i++) {
+    expected.push_back(json_blob(100000, i));
+    kv.rpush("n", "list", expected.back());
+  }
+  CHECK(compressed_values(kv, "n") == 1);
+  CHECK(kv.lmembers("n", "list") == expected);
+  CHECK(kv.lindex("n", "list", 3) == expected[3]);
+  // a single element past the threshold is compressed as the list is made
+  kv.lpush("n", "one", json_blob(100000, 1));
+  CHECK(compressed_values(kv, "n") == 2);
+}
+
+void test_list_crosses_threshold_exactly() {
+  SimpleKV kv;
+  kv.enable_compression("n", 1000);
+  string elem(10, 'e');
+  for (int i = 0; i < 99; i++) {
+    kv.rpush("n", "list", elem);
+  }
+  CHECK(compressed_values(kv, "n") == 0);
+  kv.lpush("n", "list", elem);
+  CHECK(compressed_values(kv, "n") == 1);
+  CHECK(kv.llen("n", "list") == 100);
+
+  // pops take their bytes off the count
+  for (int i = 0; i < 99; i++) {
+    kv.rpush("n", "queue", elem);
+  }
+  for (int i = 0; i < 50; i++) {
+    CHECK(kv.lpop("n", "queue") == elem);
+  }
+  for (int i = 0; i < 50; i++) {
+    kv.rpush("n", "queue", elem);
+  }
+  CHECK(compressed_values(kv, "n") == 1);
+  kv.rpush("n", "queue", elem);
+  CHECK(compressed_values(kv, "n") == 2);
+
+  // an emptied and recreated list starts counting from scratch
+  for (int i = 0; i < 5; i++) {
+    kv.rpush("n", "again", elem);
+  }
+  while (kv.rpop("n", "again")) {
+  }
+  for (int i = 0; i < 99; i++) {
+    kv.rpush("n", "again", elem);
+  }
+  CHECK(compressed_values(kv, "n") == 2);
+}
+
+void test_lset_and_del_recount() {
+  SimpleKV kv;
+  kv.enable_compression("n", 1000);
+  for (int i = 0; i < 10; i++) {
+    kv.rpush("n", "list", "x");
+  }
+  // growing an element in place is counted on the next push
+  CHECK(kv.lset("n", "list", 0, string(995, 'y')));
+  CHECK(compressed_values(kv, "n") == 0);
+  kv.rpush("n", "list", "x");
+  CHECK(compressed_values(kv, "n") == 1);
+
+  for (int i = 0; i < 99; i++) {
+    kv.rpush("n", "gone", string(10, 'g'));
+  }
+  CHECK(kv.del("n", "gone"));
+  kv.rpush("n", "gone", string(10, 'g'));
+  CHECK(compressed_values(kv, "n") == 1);
+}
+
+void test_lists_stored_before() {
+  SimpleKV kv;
+  for (int i = 0; i < 5; i++) {
+    kv.rpush("n", "list", json_blob(1000, i));
+  }
+  kv.enable_compression("n", 4096);
+  CHECK(compressed_values(kv, "n") == 0);
+  kv.rpush("n", "list", "one more");
+  CHECK(compressed_values(kv, "n") == 1);
+  CHECK(kv.llen("n", "list") == 6);
+}
+
+// bulk_load and pushes make the same choice for the same list
+void test_bulk_load_agrees_with_pushes() {
+  SimpleKV loaded;
+  SimpleKV pushed;
+  loaded.enable_compression("n", 1000);
+  pushed.enable_compression("n", 1000);
+  stringstream in;
+  for (int i = 0; i < 5; i++) {
+    string elem = json_blob(300, i);
+    in << "R\tn\tlist\t" << elem << "\n";
+    pushed.rpush("n", "list", elem);
+  }
+  CHECK(loaded.bulk_load(in, bulk_format::lines) == size_t{5});
+  CHECK(compressed_values(loaded, "n") == 1);
+  CHECK(compressed_values(pushed, "n") == 1);
+  CHECK(loaded.lmembers("n", "list") == pushed.lmembers("n", "list"));
+}
+
+// A compressed and an uncompressed store have to agree on every operation
+void test_matches_uncompressed() {
+  mt19937 rng(5);
+  SimpleKV plain;
+  SimpleKV packed;
+  packed.enable_compression("n", 200);
+  packed.enable_interning("n");
+  for (int step = 0; step < 30000; step++) {
+    string key = "k" + to_string(rng() % 20);
+    string value = rng() % 4 == 0 ? json_blob(50 + rng() % 400, rng() % 5)
+                                  : "v" + to_string(rng() % 10);
+    size_t index = rng() % 100;
+    switch (rng() % 9) {
+      case 0:
+        plain.sset("n", key, value);
+        packed.sset("n", key, value);
+        break;
+      case 1:
+      case 2:
+        CHECK(plain.rpush("n", key, value) == packed.rpush("n", key, value));
+        break;
+      case 3:
+        CHECK(plain.lpush("n", key, value) == packed.lpush("n", key, value));
+        break;
+      case 4:
+        CHECK(plain.lpop("n", key) == packed.lpop("n", key));
+        break;
+      case 5:
+        CHECK(plain.rpop("n", key) == packed.rpop("n", key));
+        break;
+      case 6:
+        CHECK(plain.lset("n", key, index, value) ==
+              packed.lset("n", key, index, value));
+        break;
+      case 7:
+        CHECK(plain.lindex("n", key, index) == packed.lindex("n", key, index));
+        CHECK(plain.llen("n", key) == packed.llen("n", key));
+        break;
+      default:
+        if (rng() % 20 == 0) {
+          CHECK(plain.del("n", key) == packed.del("n", key));
+        }
+        CHECK(plain.sget("n", key) == packed.sget("n", key));
+        CHECK(plain.lmembers("n", key) == packed.lmembers("n", key));
+        break;
+    }
+  }
+  CHECK(compressed_values(packed, "n") > 0);
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_codec_round_trip);
+  RUN(test_strings);
+  RUN(test_short_list_of_large_elements);
+  RUN(test_list_crosses_threshold_exactly);
+  RUN(test_lset_and_del_recount);
+  RUN(test_lists_stored_before);
+  RUN(test_bulk_load_agrees_with_pushes);
+  RUN(test_matches_uncompressed);
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./StringPool.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+optional<vector<string>> sorted(optional<vector<string>> list) {
+  if (list) {
+    sort(list->begin(), list->end());
+  }
+  return list;
+}
+
+void test_string_pool() {
+  StringPool pool;
+  {
+    auto a = pool.intern("status=ok");
+    auto b = pool.intern("status=ok");
+    auto c = pool.intern("status=failed");
+    CHECK(a == b);
+    CHECK(a.id() == b.id());
+    CHECK(a != c);
+    CHECK(a.str() == "status=ok");
+    CHECK(pool.size() == 2);
+    // copies and moves keep the entry alive, the last handle frees it
+    InternedString copy = a;
+    InternedString moved = move(b);
+    a = c;
+    CHECK(pool.size() == 2);
+    CHECK(copy.str() == "status=ok");
+    CHECK(moved == copy);
+  }
+  CHECK(pool.size() == 0);
+}
+
+void test_repeated_values_stored_once() {
+  SimpleKV kv;
+  kv.enable_interning("n");
+  for (int i = 0; i < 1000; i++) {
+    kv.rpush("n", "list" + to_string(i % 10), "tenant-" + to_string(i % 4));
+    kv.sset("n", "status" + to_string(i), i % 2 == 0 ? "ok" : "failed");
+  }
+  CHECK(kv.interned_strings() == 6);
+  CHECK(kv.sget("n", "status7") == "failed");
+  CHECK(kv.lindex("n", "list3", 0) == "tenant-3");
+  CHECK(kv.llen("n", "list3") == 100);
+  // deleting every holder of a string takes it out of the pool
+  for (int i = 0; i < 1000; i++) {
+    kv.del("n", "status" + to_string(i));
+  }
+  CHECK(kv.interned_strings() == 4);
+  for (int i = 0; i < 10; i++) {
+    kv.del("n", "list" + to_string(i));
+  }
+  CHECK(kv.interned_strings() == 0);
+}
+
+void test_settings() {
+  SimpleKV kv;
+  kv.sset("n", "before", "v");
+  kv.enable_interning("n");
+  CHECK(kv.interned_strings() == 0);
+  kv.sset("n", "after", "v");
+  CHECK(kv.interned_strings() == 1);
+  // other namespaces are left alone
+  kv.sset("m", "k", "w");
+  CHECK(kv.interned_strings() == 1);
+  // turning it off keeps the interned values readable
+  kv.disable_interning("n");
+  kv.sset("n", "later", "x");
+  CHECK(kv.interned_strings() == 1);
+  CHECK(kv.sget("n", "after") == "v");
+  CHECK(kv.sget("n", "later") == "x");
+}
+
+// An interning store has to agree with a plain one on every operation,
+// including the set operations that compare interned lists by handle
+void test_matches_plain() {
+  mt19937 rng(11);
+  SimpleKV plain;
+  SimpleKV interned;
+  interned.enable_interning("n");
+  interned.enable_interning("m");
+  for (int step = 0; step < 30000; step++) {
+    string nspace = rng() % 4 == 0 ? "m" : "n";
+    string key = "k" + to_string(rng() % 15);
+    string value = "v" + to_string(rng() % 12);
+    size_t index = rng() % 6;
+    switch (rng() % 9) {
+      case 0:
+        plain.sset(nspace, key, value);
+        interned.sset(nspace, key, value);
+        break;
+      case 1:
+      case 2:
+        CHECK(plain.rpush(nspace, key, value) ==
+              interned.rpush(nspace, key, value));
+        break;
+      case 3:
+        CHECK(plain.lpush(nspace, key, value) ==
+              interned.lpush(nspace, key, value));
+        break;
+      case 4:
+        CHECK(plain.lpop(nspace, key) == interned.lpop(nspace, key));
+        CHECK(plain.rpop(nspace, key) == interned.rpop(nspace, key));
+        break;
+      case 5:
+        CHECK(plain.lset(nspace, key, index, value) ==
+              interned.lset(nspace, key, index, value));
+        break;
+      case 6: {
+        string nspace2 = rng() % 4 == 0 ? "m" : "n";
+        string key2 = "k" + to_string(rng() % 15);
+        CHECK(sorted(plain.lunion(nspace, key, nspace2, key2)) ==
+              sorted(interned.lunion(nspace, key, nspace2, key2)));
+        CHECK(sorted(plain.linter(nspace, key, nspace2, key2)) ==
+              sorted(interned.linter(nspace, key, nspace2, key2)));
+        CHECK(sorted(plain.ldiff(nspace, key, nspace2, key2)) ==
+              sorted(interned.ldiff(nspace, key, nspace2, key2)));
+        break;
+      }
+      case 7:
+        CHECK(plain.del(nspace, key) == interned.del(nspace, key));
+        break;
+      default:
+        CHECK(plain.sget(nspace, key) == interned.sget(nspace, key));
+        CHECK(plain.lmembers(nspace, key) == interned.lmembers(nspace, key));
+        CHECK(plain.lindex(nspace, key, index) ==
+              interned.lindex(nspace, key, index));
+        CHECK(plain.type(nspace, key) == interned.type(nspace, key));
+        break;
+    }
+  }
+  // at most the 12 distinct values are ever pooled
+  CHECK(interned.interned_strings() <= 12);
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_string_pool);
+  RUN(test_repeated_values_stored_once);
+  RUN(test_settings);
+  RUN(test_matches_plain);
+  return 0;
+}
@@ -0,0 +1,236 @@
+#include <atomic>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+void test_basic() {
+  SimpleKV kv;
+  auto h = kv.handle("n", "k");
+  CHECK(h.nspace() == "n");
+  CHECK(h.key() == "k");
+  // the key doesn't have to exist yet
+  CHECK(!kv.key_exists(h));
+  CHECK(kv.type(h) == value_type_info::none);
+  CHECK(!kv.sget(h).has_value());
+  CHECK(kv.llen(h) == -1);
+  kv.sset(h, "v");
+  CHECK(kv.sget("n", "k") == "v");
+  CHECK(kv.sget(h) == "v");
+  // a push onto a string fails, the same as with names
+  CHECK(!kv.rpush(h, "x"));
+  CHECK(kv.del(h));
+  CHECK(!kv.del(h));
+  CHECK(kv.rpush(h, "b"));
+  CHECK(kv.lpush(h, "a"));
+  CHECK(kv.lmembers(h) == vector<string>({"a", "b"}));
+  CHECK(kv.lset(h, 1, "c"));
+  CHECK(!kv.lset(h, 2, "c"));
+  CHECK(kv.lindex(h, 1) == "c");
+  CHECK(kv.lpop(h) == "a");
+  CHECK(kv.rpop(h) == "c");
+  // the emptied list is gone, and so is its namespace
+  CHECK(!kv.key_exists(h));
+  CHECK(!kv.ns_exists("n"));
+}
+
+// Handles on one store and names on another have to agree through every
+// kind of change that can move a value: deletes of other keys, writes by
+// name, clones, and settings turning on and off
+void test_matches_names() {
+  mt19937 rng(4);
+  SimpleKV handled;
+  SimpleKV named;
+  vector<KeyHandle> handles;
+  for (int i = 0; i < 10; i++) {
+    handles.push_back(handled.handle(i < 7 ? "n" : "m", "k" + to_string(i)));
+  }
+  unique_ptr<SimpleKV> clone;
+  for (int step = 0; step < 50000; step++) {
+    size_t which = rng() % handles.size();
+    const auto& h = handles[which];
+    const string& ns = h.nspace();
+    const string& key = h.key();
+    string value = "v" + to_string(rng() % 6);
+    size_t index = rng() % 4;
+    switch (rng() % 16) {
+      case 0:
+        handled.sset(h, value);
+        named.sset(ns, key, value);
+        break;
+      case 1:
+      case 2:
+        CHECK(handled.rpush(h, value) == named.rpush(ns, key, value));
+        break;
+      case 3:
+        CHECK(handled.lpush(h, value) == named.lpush(ns, key, value));
+        break;
+      case 4:
+        CHECK(handled.lpop(h) == named.lpop(ns, key));
+        break;
+      case 5:
+        CHECK(handled.rpop(h) == named.rpop(ns, key));
+        break;
+      case 6:
+        CHECK(handled.lset(h, index, value) ==
+              named.lset(ns, key, index, value));
+        break;
+      case 7:
+        CHECK(handled.del(h) == named.del(ns, key));
+        break;
+      case 8:
+        // the same key changed by name behind the handle's back
+        handled.rpush(ns, key, value);
+        named.rpush(ns, key, value);
+        break;
+      case 9: {
+        // another key going away can move things around in the hash table
+        string other = "k" + to_string(rng() % 10);
+        CHECK(handled.del(ns, other) == named.del(ns, other));
+        break;
+      }
+      case 10:
+        // a clone shares the namespaces until the next write
+        clone = handled.clone();
+        if (rng() % 2 == 0) {
+          clone->sset(ns, key, "only in the clone");
+        }
+        break;
+      case 11:
+        switch (rng() % 6) {
+          case 0:
+            handled.enable_compression(ns, 8);
+            break;
+          case 1:
+            handled.disable_compression(ns);
+            break;
+          case 2:
+            handled.enable_interning(ns);
+            break;
+          case 3:
+            handled.disable_interning(ns);
+            break;
+          case 4:
+            handled.enable_value_index(ns);
+            break;
+          default:
+            handled.disable_value_index(ns);
+            break;
+        }
+        break;
+      default:
+        CHECK(handled.sget(h) == named.sget(ns, key));
+        CHECK(handled.lmembers(h) == named.lmembers(ns, key));
+        CHECK(handled.lindex(h, index) == named.lindex(ns, key, index));
+        CHECK(handled.llen(h) == named.llen(ns, key));
+        CHECK(handled.type(h) == named.type(ns, key));
+        CHECK(handled.key_exists(h) == named.key_exists(ns, key));
+        break;
+    }
+  }
+  for (const auto& h : handles) {
+    CHECK(handled.sget(h) == named.sget(h.nspace(), h.key()));
+    CHECK(handled.lmembers(h) == named.lmembers(h.nspace(), h.key()));
+  }
+}
+
+// A handle made by one object still works on another, by name
+void test_foreign_handles() {
+  SimpleKV a;
+  SimpleKV b;
+  auto h = a.handle("n", "k");
+  a.sset(h, "in a");
+  b.sset(h, "in b");
+  CHECK(a.sget(h) == "in a");
+  CHECK(b.sget(h) == "in b");
+  auto copy = a.clone();
+  CHECK(copy->sget(h) == "in a");
+  copy->sset(h, "in the clone");
+  CHECK(a.sget(h) == "in a");
+  CHECK(copy->sget("n", "k") == "in the clone");
+}
+
+// A store created at the address of a destroyed one must not trust the
+// destroyed store's handles, even where the generations line up
+void test_recreated_at_same_address() {
+  alignas(SimpleKV) unsigned char buf[sizeof(SimpleKV)];
+  auto* first = new (buf) SimpleKV;
+  first->rpush("n", "l", "a");
+  first->rpush("n", "l", "b");
+  auto h = first->handle("n", "l");
+  CHECK(first->rpop(h) == "b");
+  first->~SimpleKV();
+
+  auto* second = new (buf) SimpleKV;
+  CHECK(static_cast<void*>(second) == static_cast<void*>(buf));
+  second->rpush("n", "l", "x");
+  second->rpush("n", "l", "y");
+  second->rpush("n", "l", "z");
+  CHECK(second->rpop(h) == "z");
+  second->rpush(h, "w");
+  CHECK(second->lmembers("n", "l") == vector<string>({"x", "y", "w"}));
+  second->~SimpleKV();
+}
+
+// Each thread works through its own handles while other threads delete
+// and clone, bumping the generation the handles check
+void test_threads() {
+  SimpleKV kv;
+  atomic<bool> stop{false};
+  thread churn([&] {
+    mt19937 rng(1);
+    while (!stop.load()) {
+      string key = "churn" + to_string(rng() % 50);
+      kv.sset("n", key, "x");
+      kv.del("n", key);
+      if (rng() % 50 == 0) {
+        kv.clone();
+      }
+    }
+  });
+  vector<thread> workers;
+  for (int t = 0; t < 4; t++) {
+    workers.emplace_back([&, t] {
+      vector<KeyHandle> handles;
+      for (int i = 0; i < 5; i++) {
+        handles.push_back(
+            kv.handle("n", "t" + to_string(t) + "_" + to_string(i)));
+      }
+      for (int round = 0; round < 5000; round++) {
+        auto& h = handles[round % handles.size()];
+        CHECK(kv.rpush(h, to_string(round)));
+        CHECK(kv.lpop(h) == to_string(round));
+        kv.sset(h, to_string(round));
+        CHECK(kv.sget(h) == to_string(round));
+        CHECK(kv.del(h));
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  stop = true;
+  churn.join();
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_basic);
+  RUN(test_matches_names);
+  RUN(test_foreign_handles);
+  RUN(test_recreated_at_same_address);
+  RUN(test_threads);
+  return 0;
+}
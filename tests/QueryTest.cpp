@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./Query.hpp"
+#include "./SimpleKV.hpp"
+#include "./ThreadPool.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+// Every task of every batch runs exactly once, whatever the batch size.
+// Back to back batches are where a worker still draining the last batch
+// meets the tasks of the next one.
+void test_pool_runs_in_a_loop() {
+  for (size_t threads : {1, 2, 4, 7}) {
+    ThreadPool pool(threads);
+    CHECK(pool.size() == threads);
+    for (int round = 0; round < 20000; round++) {
+      size_t tasks = 1 + round % 13;
+      vector<int> ran(tasks, 0);
+      vector<function<void()>> batch;
+      for (size_t i = 0; i < tasks; i++) {
+        batch.emplace_back([&ran, i] { ran[i]++; });
+      }
+      pool.run(move(batch));
+      for (int count : ran) {
+        CHECK(count == 1);
+      }
+    }
+    pool.run({});
+  }
+}
+
+// Several callers share one pool, their batches take turns
+void test_pool_concurrent_callers() {
+  ThreadPool pool(4);
+  atomic<size_t> total{0};
+  vector<thread> callers;
+  for (int c = 0; c < 4; c++) {
+    callers.emplace_back([&] {
+      for (int round = 0; round < 2000; round++) {
+        atomic<size_t> mine{0};
+        vector<function<void()>> batch;
+        for (int i = 0; i < 5; i++) {
+          batch.emplace_back([&] {
+            mine++;
+            total++;
+          });
+        }
+        pool.run(move(batch));
+        CHECK(mine.load() == 5);
+      }
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  CHECK(total.load() == 4 * 2000 * 5);
+}
+
+void fill(SimpleKV& kv, int keys) {
+  for (int i = 0; i < keys; i++) {
+    string key = "k" + to_string(i);
+    if (i % 3 == 0) {
+      for (int j = 0; j <= i % 10; j++) {
+        kv.rpush("lists", key, to_string(j));
+      }
+    } else {
+      kv.sset(i % 2 == 0 ? "even" : "odd", key, to_string(i));
+    }
+  }
+}
+
+void test_count_and_map_reduce() {
+  SimpleKV kv;
+  fill(kv, 3000);
+  QueryEngine engine(kv, 4);
+  auto all = [](const string&, const string&, const ValueRef&) {
+    return true;
+  };
+  CHECK(engine.count(nullopt, all) == 3000);
+  CHECK(engine.count(string("lists"), all) == 1000);
+  CHECK(engine.count(string("missing"), all) == 0);
+  // the sum of every string, read in place
+  int64_t expected = 0;
+  for (int i = 0; i < 3000; i++) {
+    if (i % 3 != 0) {
+      expected += i;
+    }
+  }
+  auto sum = engine.map_reduce(
+      nullopt,
+      [](const string&, const string&, const ValueRef& value) {
+        return value.type() == value_type_info::string;
+      },
+      [](const string&, const string&, const ValueRef& value) {
+        return static_cast<int64_t>(stoll(string(*value.view())));
+      },
+      [](int64_t a, int64_t b) { return a + b; }, int64_t{0});
+  CHECK(sum == expected);
+  // list elements through for_each
+  auto elems = engine.map_reduce(
+      string("lists"), all,
+      [](const string&, const string&, const ValueRef& value) {
+        size_t n = 0;
+        value.for_each([&](string_view) { n++; });
+        CHECK(n == value.size());
+        return n;
+      },
+      [](size_t a, size_t b) { return a + b; }, size_t{0});
+  size_t expected_elems = 0;
+  for (int i = 0; i < 3000; i += 3) {
+    expected_elems += i % 10 + 1;
+  }
+  CHECK(elems == expected_elems);
+}
+
+void test_for_each_and_top_k() {
+  SimpleKV kv;
+  for (int i = 0; i < 2000; i++) {
+    kv.sset("n", "k" + to_string(i), string(i % 97, 'x'));
+  }
+  QueryEngine engine(kv, 3);
+  mutex seen_mtx;
+  map<string, size_t> seen;
+  engine.for_each(
+      string("n"),
+      [](const string&, const string& key, const ValueRef&) {
+        return key.back() == '7';
+      },
+      [&](const string&, const string& key, const ValueRef& value) {
+        lock_guard<mutex> lock(seen_mtx);
+        seen[key] = value.size();
+      });
+  CHECK(seen.size() == 200);
+  CHECK(seen["k17"] == 17);
+
+  auto top = engine.top_k(string("n"), 5,
+                          [](const string&, const string&,
+                             const ValueRef& value) { return value.size(); });
+  CHECK(top.size() == 5);
+  for (const auto& ranked : top) {
+    CHECK(ranked.score == 96);
+  }
+  CHECK(engine.top_k(string("n"), 0, [](const string&, const string&,
+                                        const ValueRef&) { return 0; })
+            .empty());
+  CHECK(engine.top_k(string("n"), 5000, [](const string&, const string&,
+                                           const ValueRef&) { return 0; })
+            .size() == 2000);
+}
+
+// Compressed, interned and spilled values look the same to a query
+void test_every_representation() {
+  SimpleKV kv;
+  string big(10000, 'z');
+  kv.enable_compression("c", 1000);
+  kv.sset("c", "str", big);
+  for (int i = 0; i < 200; i++) {
+    kv.rpush("c", "list", "elem" + to_string(i % 5));
+  }
+  kv.enable_interning("i");
+  kv.sset("i", "str", big);
+  kv.rpush("i", "list", "a");
+  auto log = testing::temp_path("query_tier.log");
+  CHECK(kv.enable_tiering("t", log, 0, 100));
+  kv.sset("t", "str", big);
+  // the next access sweeps the big value out
+  kv.sset("t", "small", "s");
+  CHECK(kv.tier_stats("t").spilled_values == 1);
+
+  QueryEngine engine(kv, 2);
+  auto strings = engine.map_reduce(
+      nullopt,
+      [](const string&, const string& key, const ValueRef&) {
+        return key == "str";
+      },
+      [&](const string&, const string&, const ValueRef& value) {
+        CHECK(value.type() == value_type_info::string);
+        CHECK(value.size() == big.size());
+        CHECK(value.str() == big);
+        return size_t{1};
+      },
+      [](size_t a, size_t b) { return a + b; }, size_t{0});
+  CHECK(strings == 3);
+  engine.for_each(
+      string("c"),
+      [](const string&, const string& key, const ValueRef&) {
+        return key == "list";
+      },
+      [](const string&, const string&, const ValueRef& value) {
+        CHECK(value.size() == 200);
+        CHECK(!value.view().has_value());
+      });
+  // the spilled value stays on disk
+  CHECK(kv.tier_stats("t").spilled_values == 1);
+  kv.disable_tiering("t");
+}
+
+// Queries over and over while writers change the store in between
+void test_queries_in_a_loop() {
+  SimpleKV kv;
+  QueryEngine engine(kv, 4);
+  atomic<bool> stop{false};
+  thread writer([&] {
+    mt19937 rng(1);
+    while (!stop.load()) {
+      string key = "k" + to_string(rng() % 500);
+      if (rng() % 3 == 0) {
+        kv.del("n", key);
+      } else {
+        kv.sset("n", key, "v");
+      }
+    }
+  });
+  auto all = [](const string&, const string&, const ValueRef&) {
+    return true;
+  };
+  for (int round = 0; round < 5000; round++) {
+    // the store is locked for the whole query, so it always agrees with
+    // itself
+    size_t counted = engine.count(string("n"), all);
+    CHECK(counted <= 500);
+  }
+  stop = true;
+  writer.join();
+  CHECK(engine.count(string("n"), all) == kv.keys("n").size());
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_pool_runs_in_a_loop);
+  RUN(test_pool_concurrent_callers);
+  RUN(test_count_and_map_reduce);
+  RUN(test_for_each_and_top_k);
+  RUN(test_every_representation);
+  RUN(test_queries_in_a_loop);
+  return 0;
+}
@@ -0,0 +1,247 @@
+#include <unistd.h>
+#include <atomic>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./SpillLog.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+string big(size_t i) {
+  return string(5000, static_cast<char>('a' + i % 26)) + to_string(i);
+}
+
+bool file_exists(const string& path) {
+  return access(path.c_str(), F_OK) == 0;
+}
+
+void test_spill_and_fault() {
+  SimpleKV kv;
+  auto log = testing::temp_path("tier_spill.log");
+  CHECK(kv.enable_tiering("n", log, 20000, 1000));
+  for (size_t i = 0; i < 20; i++) {
+    kv.sset("n", "s" + to_string(i), big(i));
+    kv.rpush("n", "l" + to_string(i), big(i));
+    kv.sset("n", "small" + to_string(i), "tiny");
+  }
+  auto stats = kv.tier_stats("n");
+  CHECK(stats.spilled_values > 0);
+  CHECK(stats.spills >= stats.spilled_values);
+  CHECK(file_exists(log));
+  // spilled values still look like what they are, without reading them
+  for (size_t i = 0; i < 20; i++) {
+    CHECK(kv.type("n", "s" + to_string(i)) == value_type_info::string);
+    CHECK(kv.type("n", "l" + to_string(i)) == value_type_info::list);
+  }
+  // and come back intact
+  for (size_t i = 0; i < 20; i++) {
+    CHECK(kv.sget("n", "s" + to_string(i)) == big(i));
+    CHECK(kv.lindex("n", "l" + to_string(i), 0) == big(i));
+    CHECK(kv.sget("n", "small" + to_string(i)) == "tiny");
+  }
+  CHECK(kv.tier_stats("n").faults > 0);
+  // turning it off reads everything back and removes the log
+  CHECK(kv.disable_tiering("n"));
+  CHECK(!file_exists(log));
+  CHECK(kv.tier_stats("n").spilled_values == 0);
+  for (size_t i = 0; i < 20; i++) {
+    CHECK(kv.sget("n", "s" + to_string(i)) == big(i));
+    CHECK(kv.llen("n", "l" + to_string(i)) == 1);
+  }
+}
+
+void test_compaction() {
+  SimpleKV kv;
+  auto log = testing::temp_path("tier_compact.log");
+  CHECK(kv.enable_tiering("n", log, 10000, 1000));
+  // overwrite the same keys over and over, so most of the log is garbage
+  for (int round = 0; round < 50; round++) {
+    for (size_t i = 0; i < 20; i++) {
+      kv.sset("n", "k" + to_string(i), big(i + round));
+    }
+  }
+  // compaction runs in the background, give it a moment
+  size_t log_bytes = 0;
+  for (int wait = 0; wait < 200; wait++) {
+    auto stats = kv.tier_stats("n");
+    log_bytes = stats.log_bytes;
+    if (log_bytes <= 2 * stats.spilled_bytes + (1 << 16)) {
+      break;
+    }
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+  auto stats = kv.tier_stats("n");
+  CHECK(log_bytes <= 2 * stats.spilled_bytes + (1 << 16));
+  for (size_t i = 0; i < 20; i++) {
+    CHECK(kv.sget("n", "k" + to_string(i)) == big(i + 49));
+  }
+  CHECK(!file_exists(log + ".compact"));
+}
+
+// Values in use stay in memory while the ones nobody reads are spilled,
+// and deleted or shrunk values stop counting against the budget
+void test_least_recently_used_first() {
+  SimpleKV kv;
+  auto log = testing::temp_path("tier_lru.log");
+  const size_t budget = 30000;
+  CHECK(kv.enable_tiering("n", log, budget, 1000));
+  kv.sset("n", "hot0", big(0));
+  kv.sset("n", "hot1", big(1));
+  for (size_t i = 0; i < 300; i++) {
+    CHECK(kv.sget("n", "hot0") == big(0));
+    CHECK(kv.sget("n", "hot1") == big(1));
+    kv.sset("n", "cold" + to_string(i), big(i));
+    // some keys go away again or shrink below the spill threshold
+    if (i % 3 == 0) {
+      kv.del("n", "cold" + to_string(i));
+    } else if (i % 3 == 1) {
+      kv.sset("n", "cold" + to_string(i), "small now");
+    }
+  }
+  auto stats = kv.tier_stats("n");
+  // the hot keys were read between every sweep, so they never went out
+  CHECK(stats.faults == 0);
+  CHECK(stats.spilled_values > 0);
+  // a sweep is due every quarter of the budget written
+  CHECK(stats.resident_bytes <= budget + budget / 4 + big(0).size() + 10);
+  for (size_t i = 0; i < 300; i++) {
+    if (i % 3 == 2) {
+      CHECK(kv.sget("n", "cold" + to_string(i)) == big(i));
+    }
+  }
+}
+
+// Clones spill to their original's log and read its records, and each
+// side's writes stay its own
+void test_clones() {
+  auto log = testing::temp_path("tier_clone.log");
+  auto kv = make_unique<SimpleKV>();
+  CHECK(kv->enable_tiering("n", log, 10000, 1000));
+  for (size_t i = 0; i < 20; i++) {
+    kv->sset("n", "k" + to_string(i), big(i));
+  }
+  auto copy = kv->clone();
+  copy->sset("n", "k0", "changed");
+  for (size_t i = 1; i < 20; i++) {
+    CHECK(copy->sget("n", "k" + to_string(i)) == big(i));
+  }
+  CHECK(kv->sget("n", "k0") == big(0));
+  // the clone keeps the log alive after the original is gone
+  kv.reset();
+  CHECK(file_exists(log));
+  for (size_t i = 1; i < 20; i++) {
+    CHECK(copy->sget("n", "k" + to_string(i)) == big(i));
+  }
+  copy.reset();
+  CHECK(!file_exists(log));
+}
+
+// A path already in use is refused, and the log using it keeps its records
+void test_path_conflicts() {
+  auto log = testing::temp_path("tier_conflict.log");
+  SimpleKV kv;
+  CHECK(kv.enable_tiering("n", log, 0, 100));
+  kv.sset("n", "k", big(1));
+  kv.sset("n", "small", "s");
+  CHECK(kv.tier_stats("n").spilled_values == 1);
+
+  // another namespace, another object, or the same file spelled another
+  // way, or the file compaction writes to
+  CHECK(!kv.enable_tiering("m", log, 0, 100));
+  SimpleKV other;
+  CHECK(!other.enable_tiering("n", log, 0, 100));
+  string dir = log.substr(0, log.find_last_of('/'));
+  string name = log.substr(log.find_last_of('/') + 1);
+  CHECK(!other.enable_tiering("n", dir + "/./" + name, 0, 100));
+  CHECK(!other.enable_tiering("n", log + ".compact", 0, 100));
+  CHECK(other.tier_stats("n").log_bytes == 0);
+  CHECK(kv.tier_stats("m").log_bytes == 0);
+  CHECK(kv.sget("n", "k") == big(1));
+
+  // the same namespace with the same path only changes the limits, a new
+  // path is refused
+  CHECK(kv.enable_tiering("n", log, 1 << 20, 100));
+  CHECK(kv.enable_tiering("n", dir + "/./" + name, 1 << 20, 100));
+  auto moved = testing::temp_path("tier_moved.log");
+  CHECK(!kv.enable_tiering("n", moved, 0, 100));
+  CHECK(!file_exists(moved));
+
+  // once tiering is off the path is free again
+  CHECK(kv.disable_tiering("n"));
+  CHECK(other.enable_tiering("n", log, 0, 100));
+  CHECK(other.disable_tiering("n"));
+  CHECK(!file_exists(log));
+
+  // two logs opened directly
+  SpillLog first(log);
+  SpillLog second(log);
+  CHECK(first.ok());
+  CHECK(!second.ok());
+  CHECK(first.same_file(dir + "/../" + dir.substr(dir.find_last_of('/') + 1) +
+                        "/" + name));
+}
+
+// Readers, writers and clones on a tiered namespace from several threads
+void test_concurrent() {
+  SimpleKV kv;
+  auto log = testing::temp_path("tier_threads.log");
+  CHECK(kv.enable_tiering("n", log, 50000, 1000));
+  atomic<bool> failed{false};
+  vector<thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&, t] {
+      mt19937 rng(t);
+      for (int i = 0; i < 3000; i++) {
+        size_t k = rng() % 50;
+        // each thread owns its keys, so it knows what they hold
+        string key = "t" + to_string(t) + "_" + to_string(k);
+        switch (rng() % 4) {
+          case 0:
+            kv.sset("n", key, big(k));
+            break;
+          case 1: {
+            auto value = kv.sget("n", key);
+            if (value && *value != big(k)) {
+              failed = true;
+            }
+            break;
+          }
+          case 2:
+            kv.del("n", key);
+            break;
+          default:
+            if (i % 100 == 0) {
+              auto copy = kv.clone();
+              copy->sget("n", key);
+            }
+            break;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(!failed.load());
+  CHECK(kv.disable_tiering("n"));
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_spill_and_fault);
+  RUN(test_compaction);
+  RUN(test_least_recently_used_first);
+  RUN(test_clones);
+  RUN(test_path_conflicts);
+  RUN(test_concurrent);
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./TypedNamespace.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+struct Record {
+  int32_t id;
+  double score;
+  char tag[8];
+};
+
+void test_counters() {
+  SimpleKV kv;
+  auto* counters = kv.typed<int64_t>("counters");
+  CHECK(counters != nullptr);
+  CHECK(counters->incr("views") == 1);
+  CHECK(counters->add("views", 41) == 42);
+  CHECK(counters->decr("views") == 41);
+  CHECK(counters->get("views") == int64_t{41});
+  CHECK(!counters->get("missing").has_value());
+  // the same name gives the same namespace, another type is refused
+  CHECK(kv.typed<int64_t>("counters") == counters);
+  CHECK(kv.typed<double>("counters") == nullptr);
+  // typed namespaces are apart from the string ones
+  CHECK(kv.namespaces().empty());
+  kv.sset("counters", "views", "text");
+  CHECK(counters->get("views") == int64_t{41});
+}
+
+void test_wrap_around() {
+  SimpleKV kv;
+  auto* bytes = kv.typed<uint8_t>("bytes");
+  bytes->set("b", 255);
+  CHECK(bytes->incr("b") == 0);
+  CHECK(bytes->decr("b") == 255);
+  auto* small = kv.typed<int8_t>("small");
+  small->set("s", 127);
+  CHECK(small->incr("s") == -128);
+}
+
+void test_records_and_delete() {
+  SimpleKV kv;
+  auto* records = kv.typed<Record>("records");
+  for (int i = 0; i < 100; i++) {
+    Record rec{i, i * 1.5, "tag"};
+    records->set("r" + to_string(i), rec);
+  }
+  CHECK(records->size() == 100);
+  // deletes fill the hole with the last value, every other key still works
+  for (int i = 0; i < 100; i += 3) {
+    CHECK(records->del("r" + to_string(i)));
+  }
+  CHECK(!records->del("r0"));
+  for (int i = 0; i < 100; i++) {
+    auto rec = records->get("r" + to_string(i));
+    CHECK(rec.has_value() == (i % 3 != 0));
+    if (rec) {
+      CHECK(rec->id == i);
+      CHECK(rec->score == i * 1.5);
+    }
+  }
+  auto keys = records->keys();
+  CHECK(keys.size() == records->size());
+  CHECK(records->update("r1", [](Record& rec) { rec.score = -1; }));
+  CHECK(!records->update("r0", [](Record& rec) { rec.score = -1; }));
+  CHECK(records->get("r1")->score == -1);
+}
+
+void test_bool() {
+  SimpleKV kv;
+  auto* flags = kv.typed<bool>("flags");
+  flags->set("on", true);
+  flags->set("off", false);
+  CHECK(flags->get("on") == true);
+  CHECK(flags->get("off") == false);
+}
+
+void test_clone_copies() {
+  SimpleKV kv;
+  kv.typed<int64_t>("counters")->set("c", 5);
+  auto copy = kv.clone();
+  copy->typed<int64_t>("counters")->incr("c");
+  CHECK(kv.typed<int64_t>("counters")->get("c") == int64_t{5});
+  CHECK(copy->typed<int64_t>("counters")->get("c") == int64_t{6});
+}
+
+// incr from several threads at once must not lose any increments
+void test_concurrent_increments() {
+  SimpleKV kv;
+  auto* counters = kv.typed<int64_t>("counters");
+  const int threads = 8;
+  const int per_thread = 20000;
+  vector<thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < per_thread; i++) {
+        counters->incr("shared");
+        if (i % 100 == 0) {
+          counters->set("own" + to_string(t), i);
+          counters->del("own" + to_string(t));
+        }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  CHECK(counters->get("shared") == int64_t{threads * per_thread});
+  CHECK(counters->size() == 1);
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_counters);
+  RUN(test_wrap_around);
+  RUN(test_records_and_delete);
+  RUN(test_bool);
+  RUN(test_clone_copies);
+  RUN(test_concurrent_increments);
+  return 0;
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./SimpleKV.hpp"
+#include "./ValueIndex.hpp"
+#include "./tests/Check.hpp"
+
+using namespace std;
+using namespace simplekv;
+
+namespace {
+
+vector<string> sorted(vector<string> keys) {
+  sort(keys.begin(), keys.end());
+  return keys;
+}
+
+void test_index_counts_copies() {
+  ValueIndex index;
+  index.add_element("list", "a");
+  index.add_element("list", "a");
+  index.add_element("other", "a");
+  index.remove_element("list", "a");
+  // one copy is left in list
+  CHECK(sorted(index.lists_containing("a")) ==
+        vector<string>({"list", "other"}));
+  index.remove_element("list", "a");
+  CHECK(index.lists_containing("a") == vector<string>({"other"}));
+  index.add_string("k1", "v");
+  index.add_string("k2", "v");
+  index.remove_string("k1", "v");
+  CHECK(index.keys_with_value("v") == vector<string>({"k2"}));
+  CHECK(index.keys_with_value("missing").empty());
+  index.clear();
+  CHECK(index.lists_containing("a").empty());
+  CHECK(index.keys_with_value("v").empty());
+}
+
+void test_index_copies() {
+  ValueIndex index;
+  index.add_element("list", "a");
+  index.add_element("list", "b");
+  index.add_string("k", "v");
+  ValueIndex copy(index);
+  index.remove_element("list", "a");
+  index.remove_string("k", "v");
+  copy.add_element("other", "b");
+  // each side only sees its own changes
+  CHECK(copy.lists_containing("a") == vector<string>({"list"}));
+  CHECK(copy.keys_with_value("v") == vector<string>({"k"}));
+  CHECK(index.lists_containing("a").empty());
+  CHECK(index.keys_with_value("v").empty());
+  CHECK(index.lists_containing("b") == vector<string>({"list"}));
+  CHECK(sorted(copy.lists_containing("b")) ==
+        vector<string>({"list", "other"}));
+}
+
+void test_built_from_existing_values() {
+  SimpleKV kv;
+  kv.sset("n", "a", "x");
+  kv.sset("n", "b", "x");
+  kv.rpush("n", "list", "x");
+  kv.rpush("n", "list", "y");
+  kv.enable_value_index("n");
+  CHECK(sorted(kv.find_by_value("n", "x")) == vector<string>({"a", "b"}));
+  CHECK(kv.find_lists_containing("n", "y") == vector<string>({"list"}));
+  // turning it off falls back to scanning with the same answers
+  kv.disable_value_index("n");
+  CHECK(sorted(kv.find_by_value("n", "x")) == vector<string>({"a", "b"}));
+  CHECK(kv.find_lists_containing("n", "y") == vector<string>({"list"}));
+  CHECK(kv.find_by_value("missing", "x").empty());
+}
+
+// Checks every value the random ops can produce against a scan of a store
+// that was never indexed
+void check_same(SimpleKV& indexed, SimpleKV& scanned, int values) {
+  for (int v = 0; v < values; v++) {
+    string value = "v" + to_string(v);
+    CHECK(sorted(indexed.find_by_value("n", value)) ==
+          sorted(scanned.find_by_value("n", value)));
+    CHECK(sorted(indexed.find_lists_containing("n", value)) ==
+          sorted(scanned.find_lists_containing("n", value)));
+  }
+}
+
+// Every write that can change a value has to keep the index right,
+// including with the other per-namespace settings on
+void test_matches_scan() {
+  for (int settings = 0; settings < 3; settings++) {
+    mt19937 rng(7 + settings);
+    SimpleKV indexed;
+    SimpleKV scanned;
+    indexed.enable_value_index("n");
+    if (settings == 1) {
+      indexed.enable_interning("n");
+    } else if (settings == 2) {
+      indexed.enable_compression("n", 64);
+    }
+    for (int step = 0; step < 20000; step++) {
+      string key = "k" + to_string(rng() % 30);
+      string value = "v" + to_string(rng() % 10);
+      size_t index = rng() % 8;
+      switch (rng() % 9) {
+        case 0:
+          indexed.sset("n", key, value);
+          scanned.sset("n", key, value);
+          break;
+        case 1:
+        case 2:
+          indexed.rpush("n", key, value);
+          scanned.rpush("n", key, value);
+          break;
+        case 3:
+          indexed.lpush("n", key, value);
+          scanned.lpush("n", key, value);
+          break;
+        case 4:
+          CHECK(indexed.lpop("n", key) == scanned.lpop("n", key));
+          break;
+        case 5:
+          CHECK(indexed.rpop("n", key) == scanned.rpop("n", key));
+          break;
+        case 6:
+          CHECK(indexed.lset("n", key, index, value) ==
+                scanned.lset("n", key, index, value));
+          break;
+        case 7:
+          CHECK(indexed.del("n", key) == scanned.del("n", key));
+          break;
+        default: {
+          // a small bulk load replacing a few keys
+          stringstream in("S\tn\t" + key + "\t" + value + "\nR\tn\tloaded\t" +
+                          value + "\n");
+          stringstream in2(in.str());
+          CHECK(indexed.bulk_load(in, bulk_format::lines, 2) ==
+                scanned.bulk_load(in2, bulk_format::lines, 2));
+          break;
+        }
+      }
+      if (step % 500 == 0) {
+        check_same(indexed, scanned, 10);
+      }
+    }
+    check_same(indexed, scanned, 10);
+  }
+}
+
+// A clone starts with the index of the original, and later writes to
+// either side don't show up in the other's
+void test_clones() {
+  SimpleKV kv;
+  kv.enable_value_index("n");
+  kv.sset("n", "a", "x");
+  auto copy = kv.clone();
+  copy->sset("n", "b", "x");
+  kv.sset("n", "a", "y");
+  CHECK(kv.find_by_value("n", "x").empty());
+  CHECK(kv.find_by_value("n", "y") == vector<string>({"a"}));
+  CHECK(sorted(copy->find_by_value("n", "x")) == vector<string>({"a", "b"}));
+  CHECK(copy->find_by_value("n", "y").empty());
+}
+
+// Lookups from several threads while others write
+void test_concurrent() {
+  SimpleKV kv;
+  kv.enable_value_index("n");
+  atomic<bool> stop{false};
+  vector<thread> threads;
+  for (int t = 0; t < 3; t++) {
+    threads.emplace_back([&, t] {
+      mt19937 rng(t);
+      for (int i = 0; i < 20000; i++) {
+        string key = "k" + to_string(t) + "_" + to_string(rng() % 50);
+        if (rng() % 2 == 0) {
+          kv.sset("n", key, "v" + to_string(rng() % 5));
+        } else {
+          kv.rpush("n", "list" + to_string(t), "v" + to_string(rng() % 5));
+          kv.lpop("n", "list" + to_string(t));
+        }
+      }
+    });
+  }
+  thread reader([&] {
+    while (!stop.load()) {
+      // every key the index hands back really holds the value
+      for (const auto& key : kv.find_by_value("n", "v1")) {
+        auto value = kv.sget("n", key);
+        CHECK(!value || value->size() == 2);
+      }
+      kv.find_lists_containing("n", "v2");
+    }
+  });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  stop = true;
+  reader.join();
+  for (const auto& key : kv.find_by_value("n", "v1")) {
+    CHECK(kv.sget("n", key) == "v1");
+  }
+}
+
+}  // namespace
+
+int main() {
+  RUN(test_index_counts_copies);
+  RUN(test_index_copies);
+  RUN(test_built_from_existing_values);
+  RUN(test_matches_scan);
+  RUN(test_clones);
+  RUN(test_concurrent);
+  return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Builds and runs every test in this directory against the sources in the
+# repository root. Extra compiler flags can be passed in CXXFLAGS, for
+# example CXXFLAGS=-fsanitize=thread to look for data races.
+#
+#   tests/run.sh              run every test
+#   tests/run.sh Cluster      run only tests/ClusterTest.cpp
+
+set -e
+cd "$(dirname "$0")/.."
+CXX=${CXX:-g++}
+OUT=${OUT:-/tmp/simplekv_tests}
+mkdir -p "$OUT"
+FLAGS="-std=c++17 -O1 -g -Wall -Wextra -pthread $CXXFLAGS -I."
+
+# the library is built once and linked into every test
+OBJECTS=""
+for src in *.cpp; do
+  obj="$OUT/$(basename "$src" .cpp).o"
+  $CXX $FLAGS -c "$src" -o "$obj"
+  OBJECTS="$OBJECTS $obj"
+done
+
+if [ $# -gt 0 ]; then
+  TESTS=""
+  for name in "$@"; do
+    TESTS="$TESTS tests/${name}Test.cpp"
+  done
+else
+  TESTS=$(ls tests/*Test.cpp)
+fi
+
+for test in $TESTS; do
+  name=$(basename "$test" .cpp)
+  echo "$name"
+  $CXX $FLAGS "$test" $OBJECTS -o "$OUT/$name"
+  "$OUT/$name"
+done
+echo "all tests passed"